@@ -0,0 +1,217 @@
+// benchmarks. requires C++11.
+// build with something like: g++ -O2 -g -fno-omit-frame-pointer bench.cc heal.cpp -lpthread
+
+#include <stdio.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "heal.hpp"
+
+namespace {
+
+    double now() {
+        return std::chrono::duration<double>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+    }
+
+    // run `fn` on `threads` threads at once, return wall time in seconds
+    template<typename FN>
+    double parallel( unsigned threads, FN fn ) {
+        std::atomic<bool> go( false );
+        std::vector<std::thread> pool;
+        for( unsigned t = 0; t < threads; ++t ) {
+            pool.push_back( std::thread( [&]() { while( !go ) std::this_thread::yield(); fn(); } ) );
+        }
+        double start = now();
+        go = true;
+        for( unsigned t = 0; t < threads; ++t ) pool[t].join();
+        return now() - start;
+    }
+
+    // capture stacks from `depth` frames deep
+    #if defined(__GNUC__)
+    __attribute__((noinline))
+    #endif
+    unsigned recurse( unsigned depth, unsigned captures ) {
+        if( depth ) return recurse( depth - 1, captures ) + 1;
+        unsigned frames = 0;
+        for( unsigned i = 0; i < captures; ++i ) {
+            heal::callstack cs( true );
+            frames += unsigned( cs.frames.size() );
+        }
+        return frames / ( captures ? captures : 1 );
+    }
+
+    void bench_unwinders() {
+        const char *names[] = { "backtrace", "framepointer", "ehframe" };
+        const unsigned depth = 32, captures = 20000;
+        unsigned cores = std::thread::hardware_concurrency();
+
+        printf("%-14s %8s %8s %14s %12s %16s\n", "unwinder", "threads", "frames", "ns/capture", "ns/frame", "captures/s");
+        for( int engine = heal::backtrace_unwinder; engine <= heal::ehframe_unwinder; ++engine ) {
+            if( !heal::set_unwinder( heal::unwinder( engine ) ) ) {
+                printf("%-14s (not available)\n", names[engine] );
+                continue;
+            }
+            recurse( depth, 100 ); // warm-up
+            for( unsigned threads = 1; threads <= ( cores ? cores : 1 ); threads *= 2 ) {
+                std::atomic<unsigned> frames( 0 );
+                double secs = parallel( threads, [&]() { frames = recurse( depth, captures ); } );
+                double per_capture = secs * 1e9 / captures; // wall time per capture on each thread
+                printf("%-14s %8u %8u %14.1f %12.2f %16.0f\n", names[engine], threads, unsigned(frames),
+                    per_capture, per_capture / ( frames ? unsigned(frames) : 1 ), threads * captures / secs );
+            }
+        }
+        heal::set_unwinder( heal::backtrace_unwinder );
+    }
+
+    // warn() dispatch on all cores, while another thread keeps registering and removing handlers
+    void bench_warn() {
+        const unsigned calls = 2000000;
+        unsigned cores = std::thread::hardware_concurrency();
+        std::atomic<uint64_t> handled( 0 );
+        heal::callback_chain::handle h = heal::warns.push_back( [&]( const std::string & ) {
+            handled.fetch_add( 1, std::memory_order_relaxed );
+            return true;
+        } );
+        const std::string text = "warning";
+
+        printf("%-14s %8s %14s %16s\n", "warn", "threads", "ns/call", "calls/s");
+        for( unsigned threads = 1; threads <= ( cores ? cores : 1 ); threads *= 2 ) {
+            std::atomic<bool> done( false );
+            std::thread churn( [&]() {
+                while( !done ) heal::warns.remove( heal::warns.push_back( []( const std::string & ) { return false; } ) );
+            } );
+            double secs = parallel( threads, [&]() { for( unsigned i = 0; i < calls; ++i ) heal::warn( text ); } );
+            done = true;
+            churn.join();
+            printf("%-14s %8u %14.1f %16.0f\n", "dispatch", threads, secs * 1e9 / calls, threads * calls / secs );
+        }
+        heal::warns.remove( h );
+    }
+
+    // the sfstring formatter as it was before sfformat(): one temporary string per argument, sprintf'd numbers,
+    // and the result appended char by char
+    std::string legacy_arg( int t ) { char buf[128]; return sprintf( buf, "%d", t ) > 0 ? buf : ""; }
+    std::string legacy_arg( const std::string &t ) { return t; }
+    template<typename T1, typename T2, typename T3, typename T4>
+    std::string legacy_format( const std::string &fmt, const T1 &t1, const T2 &t2, const T3 &t3, const T4 &t4 ) {
+        std::string t[] = { std::string(), legacy_arg( t1 ), legacy_arg( t2 ), legacy_arg( t3 ), legacy_arg( t4 ) };
+        for( std::string::const_iterator it = fmt.begin(), end = fmt.end(); it != end; ++it ) {
+            unsigned index(*it);
+            if( index <= 4 ) t[0] += t[index];
+            else t[0] += *it;
+        }
+        return t[0];
+    }
+
+    // a callstack::str() row, formatted the old way, with sfformat(), and into a caller buffer
+    void bench_format() {
+        const unsigned calls = 1000000;
+        const std::string symbol = "heal::callstack::save(unsigned int)", file = "/usr/src/heal/heal.cpp";
+        const char *fmt = "#\1 \2 (\3, line \4)\n";
+        size_t bytes = 0;
+        char buf[256];
+
+        printf("%-14s %14s %16s\n", "format", "ns/call", "calls/s");
+        double start = now();
+        for( unsigned i = 0; i < calls; ++i ) bytes += legacy_format( fmt, int( i & 63 ), symbol, file, int( i ) ).size();
+        double secs = now() - start;
+        printf("%-14s %14.1f %16.0f\n", "legacy", secs * 1e9 / calls, calls / secs );
+
+        start = now();
+        for( unsigned i = 0; i < calls; ++i ) bytes += heal::sfformat( fmt, i & 63, symbol, file, i ).size();
+        secs = now() - start;
+        printf("%-14s %14.1f %16.0f\n", "sfformat", secs * 1e9 / calls, calls / secs );
+
+        start = now();
+        for( unsigned i = 0; i < calls; ++i ) bytes += heal::sfformat_to( buf, sizeof(buf), fmt, i & 63, symbol, file, i );
+        secs = now() - start;
+        printf("%-14s %14.1f %16.0f\n", "sfformat_to", secs * 1e9 / calls, calls / secs );
+        if( !bytes ) puts("");
+    }
+
+    // hexdump rendering speed, in input bytes. output goes to a sink that only counts it
+    void bench_hexdump() {
+        std::vector<unsigned char> data( 64 << 20 );
+        for( size_t i = 0; i < data.size(); ++i ) data[i] = (unsigned char)( i * 2654435761u >> 13 );
+        struct counter {
+            static void sink( const char *, size_t size, void *user ) { *(size_t *)user += size; }
+        };
+
+        printf("%-14s %8s %14s %16s\n", "hexdump", "width", "MB/s", "output MB");
+        for( unsigned width = 8; width <= 32; width *= 2 ) {
+            size_t bytes = 0;
+            double start = now();
+            heal::hexdump_to( counter::sink, &bytes, &data[0], data.size(), heal::hexdump_options( width ) );
+            double secs = now() - start;
+            printf("%-14s %8u %14.1f %16.1f\n", "hexdump_to", width, data.size() / secs / 1e6, bytes / 1e6 );
+        }
+    }
+
+    // hexdiff of two big, nearly identical buffers: almost all the time goes to mismatch() skipping equal bytes
+    void bench_hexdiff() {
+        std::vector<unsigned char> a( 256 << 20 ), b;
+        for( size_t i = 0; i < a.size(); ++i ) a[i] = (unsigned char)( i * 2654435761u >> 13 );
+        b = a;
+        for( size_t i = 1; i <= 16; ++i ) b[ b.size() / 17 * i ] ^= 0x5A;
+        struct counter {
+            static void sink( const char *, size_t size, void *user ) { *(size_t *)user += size; }
+        };
+
+        printf("%-14s %14s %16s\n", "hexdiff", "GB/s", "bytes differ");
+        size_t bytes = 0, differ = 0;
+        double start = now();
+        for( size_t i = heal::mismatch( &a[0], &b[0], a.size() ); i < a.size(); i = heal::mismatch( &a[0], &b[0], a.size(), i + 1 ) ) ++differ;
+        double secs = now() - start;
+        printf("%-14s %14.2f %16u\n", "mismatch", a.size() / secs / 1e9, unsigned( differ ) );
+
+        start = now();
+        differ = heal::hexdiff_to( counter::sink, &bytes, &a[0], &b[0], a.size() );
+        secs = now() - start;
+        printf("%-14s %14.2f %16u\n", "hexdiff_to", a.size() / secs / 1e9, unsigned( differ ) );
+    }
+
+    // HEAL_LOG() against warn() of the same text, back to back with no pauses: the sustained rate, and how many
+    // records the writer could not drain in time
+    void bench_log() {
+        const unsigned calls = 2000000;
+        std::atomic<uint64_t> handled( 0 );
+        heal::callback_chain::handle h = heal::warns.push_back( [&]( const std::string & ) {
+            handled.fetch_add( 1, std::memory_order_relaxed );
+            return true;
+        } );
+        const char *path = "bench.blog";
+
+        double start = now();
+        for( unsigned i = 0; i < calls; ++i ) heal::warn( "request " + std::to_string( i ) + " took " + std::to_string( i & 1023 ) + " us" );
+        double warn_secs = now() - start;
+        heal::warns.remove( h );
+
+        heal::binlog::start( path );
+        start = now();
+        for( unsigned i = 0; i < calls; ++i ) HEAL_LOG( "request \1 took \2 us", i, i & 1023 );
+        double log_secs = now() - start;
+        heal::binlog::stop();
+        uint64_t dropped = heal::binlog::dropped();
+        remove( path );
+
+        printf("%-14s %14s %16s %12s\n", "log", "ns/call", "calls/s", "dropped");
+        printf("%-14s %14.1f %16.0f %12s\n", "warn", warn_secs * 1e9 / calls, calls / warn_secs, "-" );
+        printf("%-14s %14.1f %16.0f %12llu\n", "HEAL_LOG", log_secs * 1e9 / calls, calls / log_secs, (unsigned long long)dropped );
+    }
+}
+
+int main( int argc, const char **argv ) {
+    std::string which = argc > 1 ? argv[1] : "all";
+
+    if( which == "all" || which == "unwind" ) bench_unwinders();
+    if( which == "all" || which == "warn" ) bench_warn();
+    if( which == "all" || which == "log" ) bench_log();
+    if( which == "all" || which == "format" ) bench_format();
+    if( which == "all" || which == "hexdump" ) bench_hexdump();
+    if( which == "all" || which == "hexdiff" ) bench_hexdiff();
+}
@@ -0,0 +1,30 @@
+// heal-binlog: decoder for heal binary logs. requires C++11.
+// build: g++ -O2 heal-binlog.cc heal.cpp -lpthread -o heal-binlog
+// usage: heal-binlog [log...]  (reads stdin if no files are given)
+//
+// a log is the file written between heal::binlog::start() and heal::binlog::stop().
+// output is one line per HEAL_LOG() call, sorted by time: "seconds tid file:line: text".
+
+#include <fstream>
+#include <iostream>
+
+#include "heal.hpp"
+
+int main( int argc, const char **argv ) {
+    if( argc < 2 ) {
+        std::cout << heal::binlog::decode( std::cin );
+        return 0;
+    }
+
+    int errors = 0;
+    for( int i = 1; i < argc; ++i ) {
+        std::ifstream ifs( argv[i], std::ios::binary );
+        if( !ifs.good() ) {
+            std::cerr << argv[0] << ": cannot open " << argv[i] << std::endl;
+            errors++;
+            continue;
+        }
+        std::cout << heal::binlog::decode( ifs );
+    }
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,35 @@
+// heal-crashdump: offline analyzer for heal crash files. requires C++11.
+// build: g++ -O2 heal-crashdump.cc heal.cpp -lpthread -o heal-crashdump
+// usage: heal-crashdump [-s] crashfile...  (-s also hexdumps the saved top of each stack)
+//
+// a crash file is written by the heal crash handler, see heal::set_crash_file(). symbolization
+// happens here, against the binaries named in the file, and warns on build-id mismatches.
+
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "heal.hpp"
+
+int main( int argc, const char **argv ) {
+    bool with_stacks = false;
+    int errors = 0, files = 0;
+    for( int i = 1; i < argc; ++i ) {
+        if( std::string( argv[i] ) == "-s" ) {
+            with_stacks = true;
+            continue;
+        }
+        std::ifstream ifs( argv[i], std::ios::binary );
+        if( !ifs.good() ) {
+            std::cerr << argv[0] << ": cannot open " << argv[i] << std::endl;
+            errors++;
+            continue;
+        }
+        std::cout << ( files++ ? "\n" : "" ) << heal::crash_report( ifs, "  #\1 \2\n", with_stacks );
+    }
+    if( !files && !errors ) {
+        std::cerr << "usage: " << argv[0] << " [-s] crashfile..." << std::endl;
+        return 1;
+    }
+    return errors ? 1 : 0;
+}
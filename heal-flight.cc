@@ -0,0 +1,30 @@
+// heal-flight: reader for heal flight recorder files. requires C++11.
+// build: g++ -O2 heal-flight.cc heal.cpp -lpthread -o heal-flight
+// usage: heal-flight [file...]  (reads stdin if no files are given)
+//
+// a file is what heal::flight_recorder::open() maps. it can be read while the process runs, or after it died.
+// output is one line per event, sorted by time: "seconds tid event words...", followed by its stack if any.
+
+#include <fstream>
+#include <iostream>
+
+#include "heal.hpp"
+
+int main( int argc, const char **argv ) {
+    if( argc < 2 ) {
+        std::cout << heal::flight_recorder::decode( std::cin );
+        return 0;
+    }
+
+    int errors = 0;
+    for( int i = 1; i < argc; ++i ) {
+        std::ifstream ifs( argv[i], std::ios::binary );
+        if( !ifs.good() ) {
+            std::cerr << argv[0] << ": cannot open " << argv[i] << std::endl;
+            errors++;
+            continue;
+        }
+        std::cout << heal::flight_recorder::decode( ifs );
+    }
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,46 @@
+// heal-hexdump: hexdump of files, or ranges of them. requires C++11.
+// build: g++ -O2 heal-hexdump.cc heal.cpp -lpthread -o heal-hexdump
+// usage: heal-hexdump [--skip-repeated] [-w width] [-s offset] [-n length] [-j threads] file...
+//
+// files are mmap'ed, not read, so multi-GB files and core files are fine. output matches heal::hexdump(),
+// with rows labeled by file offset. --skip-repeated prints runs of identical rows as a single "*".
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <iostream>
+
+#include "heal.hpp"
+
+int main( int argc, const char **argv ) {
+    heal::hexdump_options options;
+    uint64_t offset = 0, length = ~0ull;
+    int errors = 0, files = 0;
+
+    std::ios::sync_with_stdio( false );
+    for( int i = 1; i < argc; ++i ) {
+        std::string arg = argv[i];
+        bool value = i + 1 < argc;
+        if( arg == "--skip-repeated" ) options.skip_repeated = true;
+        else if( arg == "-w" && value ) options.width = unsigned( strtoul( argv[++i], 0, 0 ) );
+        else if( arg == "-s" && value ) offset = strtoull( argv[++i], 0, 0 );
+        else if( arg == "-n" && value ) length = strtoull( argv[++i], 0, 0 );
+        else if( arg == "-j" && value ) options.threads = unsigned( strtoul( argv[++i], 0, 0 ) );
+        else if( arg.size() > 1 && arg[0] == '-' ) {
+            std::cerr << "usage: " << argv[0] << " [--skip-repeated] [-w width] [-s offset] [-n length] [-j threads] file..." << std::endl;
+            return 1;
+        }
+        else {
+            files++;
+            if( !heal::hexdump_file( std::cout, arg, offset, length, options ) ) {
+                std::cerr << argv[0] << ": cannot dump " << arg << std::endl;
+                errors++;
+            }
+        }
+    }
+    if( !files ) {
+        std::cerr << argv[0] << ": no files given" << std::endl;
+        return 1;
+    }
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,30 @@
+// heal-symbolize: offline symbolizer for heal stack dumps. requires C++11.
+// build: g++ -O2 heal-symbolize.cc heal.cpp -lpthread -o heal-symbolize
+// usage: heal-symbolize [dump...]  (reads stdin if no files are given)
+//
+// a dump is the output of heal::module_snapshot() followed by any number of
+// callstack::dump() records. output matches callstack::str("#\1 \2\n").
+
+#include <fstream>
+#include <iostream>
+
+#include "heal.hpp"
+
+int main( int argc, const char **argv ) {
+    if( argc < 2 ) {
+        std::cout << heal::symbolize_dump( std::cin );
+        return 0;
+    }
+
+    int errors = 0;
+    for( int i = 1; i < argc; ++i ) {
+        std::ifstream ifs( argv[i] );
+        if( !ifs.good() ) {
+            std::cerr << argv[0] << ": cannot open " << argv[i] << std::endl;
+            errors++;
+            continue;
+        }
+        std::cout << heal::symbolize_dump( ifs );
+    }
+    return errors ? 1 : 0;
+}
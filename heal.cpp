@@ -22,7 +22,10 @@
 // Standard headers
 
 #include <cassert>
+#include <cerrno>
+#include <cmath>
 #include <cstdarg>
+#include <cstddef>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
@@ -30,13 +33,22 @@
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
 
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__)
+#   include <emmintrin.h>
+#   include <immintrin.h>
+#endif
+
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <iostream>
 #include <map>
 #include <set>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <unordered_map>
 
 // System headers
 
@@ -46,6 +58,7 @@
 #   include <winsock2.h>
 #   include <ws2tcpip.h>
 #   include <windows.h>
+#   include <io.h>
 #   include <commctrl.h>
 #   pragma comment(lib, "comctl32.lib")
 #   if defined _M_IX86
@@ -68,9 +81,13 @@
 #   endif
 #else
 #   include <unistd.h>
+#   include <pthread.h>
+#   include <sys/mman.h>
 #   include <signal.h>
 #   include <sys/time.h>
 #   include <sys/types.h>
+#   include <sys/stat.h>
+#   include <fcntl.h>
 //  --
 #   if defined(HAVE_SYS_SYSCTL_H) && \
         !defined(_SC_NPROCESSORS_ONLN) && !defined(_SC_NPROC_ONLN)
@@ -81,6 +98,21 @@
 #   include <execinfo.h>
 //  --
 #   include <cxxabi.h>
+//  --
+#   ifdef __linux__
+#       include <dlfcn.h>
+#       include <elf.h>
+#       include <fcntl.h>
+#       include <link.h>
+#       include <poll.h>
+#       include <sys/prctl.h>
+#       include <sys/socket.h>
+#       include <sys/stat.h>
+#       include <sys/syscall.h>
+#       include <sys/uio.h>
+#       include <sys/wait.h>
+#       include <ucontext.h>
+#   endif
 #endif
 
 #ifdef __MINGW32__
@@ -95,6 +127,7 @@
 namespace heal {
     // sfstring is a safe string replacement that does not rely on stringstream
     // this is actually safer on corner cases, like crashes, exception unwinding and in exit conditions
+    // it still allocates, though: signal handlers and out of memory paths use sigsafe_writer instead
     class sfstring : public std::string
     {
         public:
@@ -128,35 +161,23 @@ namespace heal {
         sfstring( const std::string &t ) : std::string( t )
         {}
 
-        sfstring( const int &t ) : std::string() {
-            char buf[128];
-            if( sprintf(buf, "%d", t ) > 0 ) this->assign(buf);
-        }
-        sfstring( const uint16_t &t ) : std::string() {
-            char buf[128];
-            if( sprintf(buf, "%" SCNu16, t ) > 0 ) this->assign(buf);
-        }
-        sfstring( const uint32_t &t ) : std::string() {
-            char buf[128];
-            if( sprintf(buf, "%" SCNu32, t ) > 0 ) this->assign(buf);
-        }
-        sfstring( const uint64_t &t ) : std::string() {
-            char buf[128];
-            if( sprintf(buf, "%" SCNu64, t ) > 0 ) this->assign(buf);
-        }
-        sfstring( const float &t ) : std::string() {
-            char buf[128];
-            if( sprintf(buf, "%f", t ) > 0 ) this->assign(buf);
-        }
-        sfstring( const double &t ) : std::string() {
-            char buf[128];
-            if( sprintf(buf, "%lf", t ) > 0 ) this->assign(buf);
-        }
+        sfstring( const int &t ) : std::string( sfformat( "\1", t ) )
+        {}
+        sfstring( const uint16_t &t ) : std::string( sfformat( "\1", t ) )
+        {}
+        sfstring( const uint32_t &t ) : std::string( sfformat( "\1", t ) )
+        {}
+        sfstring( const int64_t &t ) : std::string( sfformat( "\1", t ) )
+        {}
+        sfstring( const uint64_t &t ) : std::string( sfformat( "\1", t ) )
+        {}
+        sfstring( const float &t ) : std::string( sfformat( "\1", t ) )
+        {}
+        sfstring( const double &t ) : std::string( sfformat( "\1", t ) )
+        {}
 $msvc(
-        sfstring( const DWORD &t ) : std::string() {
-            char buf[128];
-            if( sprintf(buf, "%" SCNu32, t ) > 0 ) this->assign(buf);
-        }
+        sfstring( const DWORD &t ) : std::string( sfformat( "\1", t ) )
+        {}
 )
 
         sfstring( char *t ) : std::string( t ? t : "" )
@@ -164,71 +185,21 @@ $msvc(
         sfstring( const char *t ) : std::string( t ? t : "" )
         {}
 
-        sfstring( void *t ) : std::string() {
-            char buf[128];
-            if( sprintf(buf, "%p", t ) > 0 ) this->assign(buf);
-        }
-        sfstring( const void *t ) : std::string() {
-            char buf[128];
-            if( sprintf(buf, "%p", t ) > 0 ) this->assign(buf);
-        }
+        sfstring( void *t ) : std::string( sfformat( "\1", t ) )
+        {}
+        sfstring( const void *t ) : std::string( sfformat( "\1", t ) )
+        {}
 #endif
 
-        // extended constructors; safe formatting
-
-        private:
-        template<unsigned N>
-        std::string &safefmt( const std::string &fmt, std::string (&t)[N] ) {
-            for( std::string::const_iterator it = fmt.begin(), end = fmt.end(); it != end; ++it ) {
-                unsigned index(*it);
-                if( index <= N ) t[0] += t[index];
-                else t[0] += *it;
-            }
-            return t[0];
-        }
-        public:
-
-        template< typename T1 >
-        sfstring( const std::string &fmt, const T1 &t1 ) : std::string() {
-            std::string t[] = { std::string(), sfstring(t1) };
-            assign( safefmt( fmt, t ) );
-        }
-
-        template< typename T1, typename T2 >
-        sfstring( const std::string &fmt, const T1 &t1, const T2 &t2 ) : std::string() {
-            std::string t[] = { std::string(), sfstring(t1), sfstring(t2) };
-            assign( safefmt( fmt, t ) );
-        }
-
-        template< typename T1, typename T2, typename T3 >
-        sfstring( const std::string &fmt, const T1 &t1, const T2 &t2, const T3 &t3 ) : std::string() {
-            std::string t[] = { std::string(), sfstring(t1), sfstring(t2), sfstring(t3) };
-            assign( safefmt( fmt, t ) );
-        }
-
-        template< typename T1, typename T2, typename T3, typename T4 >
-        sfstring( const std::string &fmt, const T1 &t1, const T2 &t2, const T3 &t3, const T4 &t4 ) : std::string() {
-            std::string t[] = { std::string(), sfstring(t1), sfstring(t2), sfstring(t3), sfstring(t4) };
-            assign( safefmt( fmt, t ) );
-        }
-
-        template< typename T1, typename T2, typename T3, typename T4, typename T5 >
-        sfstring( const std::string &fmt, const T1 &t1, const T2 &t2, const T3 &t3, const T4 &t4, const T5 &t5 ) : std::string() {
-            std::string t[] = { std::string(), sfstring(t1), sfstring(t2), sfstring(t3), sfstring(t4), sfstring(t5) };
-            assign( safefmt( fmt, t ) );
-        }
+        // extended constructors; safe formatting. see sfformat()
 
-        template< typename T1, typename T2, typename T3, typename T4, typename T5, typename T6 >
-        sfstring( const std::string &fmt, const T1 &t1, const T2 &t2, const T3 &t3, const T4 &t4, const T5 &t5, const T6 &t6 ) : std::string() {
-            std::string t[] = { std::string(), sfstring(t1), sfstring(t2), sfstring(t3), sfstring(t4), sfstring(t5), sfstring(t6) };
-            assign( safefmt( fmt, t ) );
-        }
+        template< typename T1, typename... T >
+        sfstring( const char *fmt, const T1 &t1, const T &... t ) : std::string( sfformat( fmt, t1, t... ) )
+        {}
 
-        template< typename T1, typename T2, typename T3, typename T4, typename T5, typename T6, typename T7 >
-        sfstring( const std::string &fmt, const T1 &t1, const T2 &t2, const T3 &t3, const T4 &t4, const T5 &t5, const T6 &t6, const T7 &t7 ) : std::string() {
-            std::string t[] = { std::string(), sfstring(t1), sfstring(t2), sfstring(t3), sfstring(t4), sfstring(t5), sfstring(t6), sfstring(t7) };
-            assign( safefmt( fmt, t ) );
-        }
+        template< typename T1, typename... T >
+        sfstring( const std::string &fmt, const T1 &t1, const T &... t ) : std::string( sfformat( fmt, t1, t... ) )
+        {}
 
         // chaining operators
 
@@ -337,17 +308,324 @@ $msvc(
 
 namespace heal {
 
-std::vector< heal_callback_in > warns(1);
-std::vector< heal_callback_in > fails(1);
+// warns and fails have no constructor to run: zero initialized, usable from any static initializer.
+callback_chain warns;
+callback_chain fails;
+
+struct callback_chain::snapshot {
+    std::vector< std::pair< handle, heal_callback_in > > items;
+    mutable const snapshot *retired_next;
+    mutable uint32_t retired_epoch;
+    snapshot() : retired_next( 0 ), retired_epoch( 0 ) {}
+};
+
+namespace {
+    std::mutex chain_mutex; // writers only
+    std::atomic< callback_chain::handle > chain_handles( 0 );
+
+    $tls( bool in_warn ) = false;
+    $tls( bool in_fail ) = false;
+
+    // a handler that warns again is not re-entered on the same thread
+    struct recursion_guard {
+        bool &flag;
+        bool entered;
+        explicit recursion_guard( bool &flag ) : flag( flag ), entered( !flag ) { flag = true; }
+        ~recursion_guard() { if( entered ) flag = false; }
+    };
+
+    std::atomic< unsigned > chain_stripes( 0 );
+    $tls( unsigned chain_stripe ) = ~0u;
+}
+
+// held while a reader walks a snapshot. registers in this thread's stripe for the current epoch, and retries
+// if the epoch moved meanwhile: a writer that then finds the stripes of that parity empty knows every reader
+// still around entered later, and sees whatever is current by now
+struct chain_reader {
+    std::atomic< uint32_t > *count;
+    explicit chain_reader( const callback_chain &chain ) {
+        if( chain_stripe == ~0u ) chain_stripe = chain_stripes++ % callback_chain::reader_stripes;
+        for(;;) {
+            uint32_t e = chain.epoch.load();
+            count = &chain.readers[ e & 1 ][ chain_stripe ].count;
+            count->fetch_add( 1 );
+            if( chain.epoch.load() == e ) break;
+            count->fetch_sub( 1, std::memory_order_release );
+        }
+    }
+    ~chain_reader() { count->fetch_sub( 1, std::memory_order_release ); }
+};
+
+// under chain_mutex. the old snapshot is retired at the current epoch. the epoch moves on whenever no reader
+// of the previous parity is left, and snapshots retired two epochs back are freed
+void callback_chain::publish( const snapshot *next ) {
+    const snapshot *old = current.exchange( next );
+    if( old ) old->retired_next = retired, retired = old, old->retired_epoch = epoch.load();
+    for( int advance = 0; advance < 2; ++advance ) {
+        uint32_t e = epoch.load(), busy = 0;
+        for( unsigned i = 0; i < reader_stripes; ++i ) busy += readers[ ( e + 1 ) & 1 ][ i ].count.load();
+        if( busy ) break;
+        epoch.store( e + 1 );
+    }
+    uint32_t e = epoch.load();
+    for( const snapshot **link = &retired; *link; ) {
+        const snapshot *s = *link;
+        if( e - s->retired_epoch >= 2 ) *link = s->retired_next, delete s;
+        else link = &s->retired_next;
+    }
+}
+
+callback_chain::handle callback_chain::push_back( const heal_callback_in &fn ) {
+    std::lock_guard<std::mutex> lock( chain_mutex );
+    const snapshot *old = current.load( std::memory_order_acquire );
+    snapshot *next = new snapshot();
+    if( old ) next->items = old->items;
+    handle h = ++chain_handles;
+    next->items.push_back( std::make_pair( h, fn ) );
+    publish( next );
+    listeners++;
+    return h;
+}
+
+bool callback_chain::remove( handle h ) {
+    std::lock_guard<std::mutex> lock( chain_mutex );
+    const snapshot *old = current.load( std::memory_order_acquire );
+    if( !old ) return false;
+    snapshot *next = new snapshot();
+    for( size_t i = 0; i < old->items.size(); ++i )
+        if( old->items[i].first != h ) next->items.push_back( old->items[i] );
+    if( next->items.size() == old->items.size() ) {
+        delete next;
+        return false;
+    }
+    listeners--;
+    publish( next );
+    return true;
+}
+
+void callback_chain::clear() {
+    std::lock_guard<std::mutex> lock( chain_mutex );
+    const snapshot *old = current.load();
+    if( !old ) return;
+    listeners -= uint32_t( old->items.size() );
+    publish( new snapshot() );
+}
+
+size_t callback_chain::size() const {
+    chain_reader reader( *this );
+    const snapshot *s = current.load();
+    return s ? s->items.size() : 0;
+}
+
+bool callback_chain::empty() const {
+    return !size();
+}
+
+bool callback_chain::dispatch( const std::string &text ) const {
+    chain_reader reader( *this );
+    const snapshot *s = current.load();
+    for( size_t i = s ? s->items.size() : 0; i--; ) {
+        if( s->items[i].second && s->items[i].second( text ) ) return true;
+    }
+    return false;
+}
+
+// WORKERS
+// add_worker() callbacks run off the reporting thread. warn() and fail() push their text into a bounded
+// lock-free MPMC ring (D. Vyukov's) and return; worker threads drain it in batches and dispatch every report
+// through the `workers` chain. What happens on a full ring is up to the policy (see worker_policy).
+
+#ifndef HEAL_WORKER_QUEUE_SIZE
+#define HEAL_WORKER_QUEUE_SIZE 1024     // reports, rounded up to a power of two
+#endif
+
+#ifndef HEAL_WORKER_SAMPLE
+#define HEAL_WORKER_SAMPLE 16           // sample_when_full admits 1 in N reports
+#endif
+
+#ifndef HEAL_WORKER_BATCH
+#define HEAL_WORKER_BATCH 64
+#endif
+
+#ifndef HEAL_WORKER_EXIT_MS
+#define HEAL_WORKER_EXIT_MS 1000        // how long exit() waits for queued reports
+#endif
+
+namespace {
+
+    struct report_queue {
+        struct cell {
+            std::atomic<size_t> seq;
+            std::string text;
+        };
+        std::vector< cell > cells;
+        size_t mask;
+        std::atomic<size_t> head, tail;
+
+        explicit report_queue( size_t capacity ) : cells( capacity ), mask( capacity - 1 ), head( 0 ), tail( 0 ) {
+            for( size_t i = 0; i < capacity; ++i ) cells[i].seq.store( i, std::memory_order_relaxed );
+        }
+        bool push( std::string &text ) {
+            for( size_t pos = head.load( std::memory_order_relaxed );; ) {
+                cell &c = cells[ pos & mask ];
+                intptr_t diff = intptr_t( c.seq.load( std::memory_order_acquire ) ) - intptr_t( pos );
+                if( diff < 0 ) return false; // full
+                if( diff > 0 ) pos = head.load( std::memory_order_relaxed );
+                else if( head.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed ) ) {
+                    c.text.swap( text );
+                    c.seq.store( pos + 1, std::memory_order_release );
+                    return true;
+                }
+            }
+        }
+        bool pop( std::string &text ) {
+            for( size_t pos = tail.load( std::memory_order_relaxed );; ) {
+                cell &c = cells[ pos & mask ];
+                intptr_t diff = intptr_t( c.seq.load( std::memory_order_acquire ) ) - intptr_t( pos + 1 );
+                if( diff < 0 ) return false; // empty
+                if( diff > 0 ) pos = tail.load( std::memory_order_relaxed );
+                else if( tail.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed ) ) {
+                    text.swap( c.text );
+                    c.text.clear();
+                    c.seq.store( pos + mask + 1, std::memory_order_release );
+                    return true;
+                }
+            }
+        }
+    };
+
+    struct report_pipeline {
+        std::mutex mutex;
+        std::condition_variable wakeup;
+        callback_chain workers;
+        report_queue *queue;
+        size_t capacity;
+        unsigned threads;
+        std::atomic<bool> started, replace_defaults;
+        std::atomic<int> policy, sleepers;
+        std::atomic<uint64_t> queued, processed, dropped, displaced, overflows;
+
+        report_pipeline() : queue( 0 ), capacity( HEAL_WORKER_QUEUE_SIZE ), threads( 1 ), started( false ), replace_defaults( false ), policy( drop_oldest ),
+            sleepers( 0 ), queued( 0 ), processed( 0 ), dropped( 0 ), displaced( 0 ), overflows( 0 )
+        {}
+        // queued counts a report before it is published, and is read last: never less than what left the queue
+        uint64_t depth() const {
+            uint64_t gone = processed.load() + displaced.load();
+            return queued.load() - gone;
+        }
+    };
+
+    report_pipeline &get_pipeline() {
+        static report_pipeline *pipeline = new report_pipeline(); // leaked on purpose; workers are never joined
+        return *pipeline;
+    }
+
+    $tls( bool in_worker ) = false;
+
+    void worker_loop( report_pipeline *p ) {
+        in_worker = true;
+        std::vector< std::string > batch( HEAL_WORKER_BATCH );
+        for(;;) {
+            size_t n = 0;
+            while( n < batch.size() && p->queue->pop( batch[n] ) ) ++n;
+            if( !n ) {
+                std::unique_lock<std::mutex> lock( p->mutex );
+                p->sleepers++;
+                p->wakeup.wait_for( lock, std::chrono::milliseconds( 10 ) ); // also covers a missed notify
+                p->sleepers--;
+                continue;
+            }
+            for( size_t i = 0; i < n; ++i ) {
+                p->workers.dispatch( batch[i] );
+                p->processed++;
+            }
+        }
+    }
+
+    void enqueue_report( const std::string &text ) {
+        report_pipeline &p = get_pipeline();
+        if( !p.started.load( std::memory_order_acquire ) ) return;
+        std::string item( text );
+        p.queued++;
+        while( !p.queue->push( item ) ) {
+            int policy = p.policy.load( std::memory_order_relaxed );
+            if( policy == block_when_full && !in_worker ) { // a worker waiting on itself would never wake up
+                std::this_thread::yield();
+                continue;
+            }
+            if( policy == sample_when_full && p.overflows++ % HEAL_WORKER_SAMPLE ) {
+                p.dropped++, p.queued--;
+                return;
+            }
+            std::string oldest;
+            if( p.queue->pop( oldest ) ) p.dropped++, p.displaced++;
+        }
+        if( p.sleepers.load( std::memory_order_relaxed ) ) p.wakeup.notify_one();
+    }
+}
+
+namespace {
+    // workers are detached: without this, whatever is still queued at exit() is lost
+    void flush_workers_at_exit() {
+        flush_workers( HEAL_WORKER_EXIT_MS );
+    }
+}
+
+void add_worker( heal_callback_in fn, bool replace_defaults ) {
+    report_pipeline &p = get_pipeline();
+    p.workers.push_back( fn );
+    if( replace_defaults ) p.replace_defaults = true;
+    std::lock_guard<std::mutex> lock( p.mutex );
+    if( p.started ) return;
+    size_t capacity = 2;
+    while( capacity < p.capacity ) capacity *= 2;
+    p.queue = new report_queue( capacity );
+    for( unsigned i = 0; i < p.threads; ++i ) std::thread( worker_loop, &p ).detach();
+    p.started.store( true, std::memory_order_release );
+    warns.listeners++, fails.listeners++; // lazy reports have a consumer now
+    std::atexit( flush_workers_at_exit );
+}
+
+bool set_worker_queue( size_t capacity, worker_policy policy, unsigned threads ) {
+    report_pipeline &p = get_pipeline();
+    std::lock_guard<std::mutex> lock( p.mutex );
+    p.policy = policy;
+    if( p.started ) return capacity == p.capacity && threads == p.threads; // too late for these
+    if( !capacity || !threads ) return false;
+    p.capacity = capacity, p.threads = threads;
+    return true;
+}
+
+bool flush_workers( unsigned timeout_ms ) {
+    report_pipeline &p = get_pipeline();
+    if( !p.started || in_worker ) return !p.started;
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds( timeout_ms );
+    while( p.depth() ) {
+        if( std::chrono::steady_clock::now() >= deadline ) return false;
+        p.wakeup.notify_all();
+        std::this_thread::sleep_for( std::chrono::microseconds( 200 ) );
+    }
+    return true;
+}
+
+worker_stats get_worker_stats() {
+    report_pipeline &p = get_pipeline();
+    worker_stats s = { p.queued, p.processed, p.dropped, p.depth() };
+    return s;
+}
 
 namespace {
+    // the default handlers block in a dialog or a debugger. add_worker( fn, true ) makes them step aside,
+    // so warn() and fail() only queue and return
     bool default_warn( const std::string &text ) {
+        if( get_pipeline().replace_defaults.load( std::memory_order_relaxed ) ) return false;
         if( text.size() ) {
             alert( text, "Warning" );
         }
         return true;       
     }
     bool default_fail( const std::string &text ) {
+        if( get_pipeline().replace_defaults.load( std::memory_order_relaxed ) ) return false;
         if( text.size() ) {
             errorbox( text, "Error" );
         }
@@ -356,32 +634,206 @@ namespace {
         }
         return true;
     }
-    const bool init_warns = (warns[0] = default_warn, true);
-    const bool init_fails = (fails[0] = default_fail, true);
+    const bool init_warns = (warns.push_back( default_warn ), true);
+    const bool init_fails = (fails.push_back( default_fail ), true);
 }
 
 void warn( const std::string &error ) {
-    static bool recursive = false;
-    if( !recursive ) {
-        recursive = true;
-        for( unsigned i = warns.size(); i--; ) {
-            if( warns[i] ) if( warns[i]( error ) ) break;
-        }
-        recursive = false;
+    recursion_guard guard( in_warn );
+    if( guard.entered ) {
+        enqueue_report( error );
+        warns.dispatch( error );
     }
 }
 
 void fail( const std::string &error ) {
-    static bool recursive = false;
-    if( !recursive ) {
-        recursive = true;
-        for( unsigned i = fails.size(); i--; ) {
-            if( fails[i] ) if( fails[i]( error ) ) break;
+    recursion_guard guard( in_fail );
+    if( guard.entered ) {
+        enqueue_report( error );
+        fails.dispatch( error );
+    }
+}
+
+bool callsite::admit_slow( int64_t now ) {
+    const int64_t interval = 1000000 / rate, window = interval * ( burst - 1 );
+    for( int64_t seen = allow_at.load( std::memory_order_relaxed );; ) {
+        if( now < seen ) {
+            suppressed.fetch_add( 1, std::memory_order_relaxed );
+            return false;
         }
-        recursive = false;
+        int64_t next = ( seen > now - window ? seen : now - window ) + interval;
+        if( allow_at.compare_exchange_weak( seen, next, std::memory_order_relaxed ) ) return true;
     }
 }
 
+std::string callsite::summary( const std::string &text ) {
+    uint64_t count = suppressed.exchange( 0, std::memory_order_relaxed );
+    if( !count ) return text;
+    return text + heal::sfstring( " (suppressed \1 times at \2:\3)", count, file, line );
+}
+
+// SAFE FORMATTING
+// Every argument is turned into a (pointer, length) piece first: strings are referenced in place and numbers
+// are printed into the piece itself. That gives the exact output length before a single byte is written.
+
+namespace {
+    struct format_piece {
+        const char *data;
+        size_t size;
+        char buf[32];
+    };
+
+    // digits of `v`, written backwards ending at `end`
+    char *write_decimal( char *end, uint64_t v ) {
+        static const char pairs[] =
+            "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+            "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+            "8081828384858687888990919293949596979899";
+        while( v >= 100 ) {
+            unsigned i = unsigned( v % 100 ) * 2;
+            v /= 100;
+            *--end = pairs[ i + 1 ], *--end = pairs[ i ];
+        }
+        if( v >= 10 ) {
+            unsigned i = unsigned( v ) * 2;
+            *--end = pairs[ i + 1 ], *--end = pairs[ i ];
+        }
+        else *--end = char( '0' + v );
+        return end;
+    }
+
+    void make_piece( format_piece &p, const fmtarg &a ) {
+        char *end = p.buf + sizeof(p.buf), *begin;
+        int len;
+        switch( a.type ) {
+            case fmtarg::i64:
+                begin = write_decimal( end, a.i < 0 ? 0 - uint64_t( a.i ) : uint64_t( a.i ) );
+                if( a.i < 0 ) *--begin = '-';
+                p.data = begin, p.size = size_t( end - begin );
+                break;
+            case fmtarg::u64:
+                begin = write_decimal( end, a.u );
+                p.data = begin, p.size = size_t( end - begin );
+                break;
+            case fmtarg::f64:
+                len = snprintf( p.buf, sizeof(p.buf), "%f", a.d );
+                if( len < 0 || len >= int( sizeof(p.buf) ) ) len = snprintf( p.buf, sizeof(p.buf), "%e", a.d ); // huge magnitudes
+                p.data = p.buf, p.size = len > 0 ? size_t( len ) : 0;
+                break;
+            case fmtarg::cstr:
+                p.data = a.s ? a.s : "", p.size = a.s ? strlen( a.s ) : 0;
+                break;
+            case fmtarg::str:
+                p.data = a.string->data(), p.size = a.string->size();
+                break;
+            case fmtarg::ptr:
+                len = snprintf( p.buf, sizeof(p.buf), "%p", a.p );
+                p.data = p.buf, p.size = len > 0 ? size_t( len ) : 0;
+                break;
+        }
+    }
+
+    struct format_plan {
+        format_piece stack[8];
+        std::vector<format_piece> heap;
+        const format_piece *pieces;
+        const char *fmt;
+        size_t fmt_len, num_args, size;
+
+        format_plan( const char *fmt, size_t fmt_len, const fmtarg *args, size_t num_args )
+        : heap( num_args > 8 ? num_args : 0 ), fmt( fmt ), fmt_len( fmt ? fmt_len : 0 ), num_args( num_args ), size( 0 ) {
+            format_piece *p = num_args > 8 ? &heap[0] : stack;
+            for( size_t i = 0; i < num_args; ++i ) make_piece( p[i], args[i] );
+            pieces = p;
+            size = this->fmt_len;
+            for( size_t i = 0; i < this->fmt_len; ++i ) {
+                unsigned index = (unsigned char)( fmt[i] - 1 ); // \1..\N become 0..N-1
+                if( $unlikely( index < num_args ) ) size += pieces[ index ].size - 1;
+            }
+        }
+
+        // writes at most `capacity` bytes: runs of literal text, then one argument
+        void write( char *out, size_t capacity ) const {
+            char *end = out + capacity;
+            for( size_t i = 0; i < fmt_len && out < end; ) {
+                size_t run = i;
+                while( run < fmt_len && (unsigned char)( fmt[run] - 1 ) >= num_args ) ++run;
+                size_t n = (std::min)( run - i, size_t( end - out ) );
+                std::memcpy( out, fmt + i, n );
+                out += n;
+                if( run == fmt_len ) break;
+                const format_piece &p = pieces[ (unsigned char)( fmt[run] - 1 ) ];
+                n = (std::min)( p.size, size_t( end - out ) );
+                std::memcpy( out, p.data, n );
+                out += n;
+                i = run + 1;
+            }
+        }
+    };
+}
+
+size_t format_list_to( char *out, size_t capacity, const char *fmt, size_t fmt_len, const fmtarg *args, size_t num_args ) {
+    format_plan plan( fmt, fmt_len, args, num_args );
+    if( capacity ) {
+        size_t n = (std::min)( plan.size, capacity - 1 );
+        plan.write( out, n );
+        out[ n ] = '\0';
+    }
+    return plan.size;
+}
+
+std::string format_list( const char *fmt, size_t fmt_len, const fmtarg *args, size_t num_args ) {
+    format_plan plan( fmt, fmt_len, args, num_args );
+    std::string out( plan.size, '\0' );
+    if( plan.size ) plan.write( &out[0], plan.size );
+    return out;
+}
+
+// sigsafe_writer: write(2) and a stack buffer only. digits come from write_decimal() above.
+
+void sigsafe_writer::flush() {
+    for( const char *p = buf; len; ) {
+        $windows( int n = _write( fd, p, len ); )
+        $welse( ssize_t n = ::write( fd, p, len ); )
+        if( n < 0 && errno == EINTR ) continue;
+        if( n <= 0 ) break;
+        p += n, len -= unsigned( n );
+    }
+    len = 0;
+}
+
+sigsafe_writer &sigsafe_writer::str( const char *s, size_t n ) {
+    while( n ) {
+        if( len == sizeof(buf) ) flush();
+        size_t chunk = (std::min)( n, sizeof(buf) - len );
+        std::memcpy( buf + len, s, chunk );
+        len += unsigned( chunk ), s += chunk, n -= chunk;
+    }
+    return *this;
+}
+
+sigsafe_writer &sigsafe_writer::str( const char *s ) {
+    return s ? str( s, strlen( s ) ) : *this;
+}
+
+sigsafe_writer &sigsafe_writer::udec( uint64_t v ) {
+    char tmp[ 24 ], *end = tmp + sizeof(tmp);
+    char *begin = write_decimal( end, v );
+    return str( begin, size_t( end - begin ) );
+}
+
+sigsafe_writer &sigsafe_writer::hex( uint64_t v, unsigned min_digits ) {
+    char tmp[ 18 ], *end = tmp + sizeof(tmp), *p = end;
+    do *--p = "0123456789abcdef"[ v & 15 ]; while( ( v >>= 4 ) && p > tmp + 2 );
+    while( unsigned( end - p ) < min_digits && p > tmp + 2 ) *--p = '0';
+    *--p = 'x', *--p = '0';
+    return str( p, size_t( end - p ) );
+}
+
+void reportf( void (*fn)( const std::string & ), const char *fmt, const fmtarg *args, size_t num_args ) {
+    fn( format_list( fmt, fmt ? strlen( fmt ) : 0, args, num_args ) );
+}
+
 bool is_asserting() {
     bool asserting = false;
     assert( asserting |= true );
@@ -649,262 +1101,3894 @@ void    alert( const         char &text, const std::string &title ) { show( to_s
 void    alert( const         bool &text, const std::string &title ) { show( to_string(text), title ); }
 void errorbox( const  std::string &body, const std::string &title ) { show( body, title, "", true );  }
 
-// DEMANGLE
-
-#if 1
-#   // Disable optimizations. Nothing gets inlined. You get pleasant stacktraces to work with.
-#   // This is the default setting.
-#   ifdef _MSC_VER
-#       pragma optimize( "gsy", off )       // disable optimizations on msvc
-#   else
-#       pragma OPTIMIZE OFF                 // disable optimizations on gcc 4.4+
-#   endif
-#else
-#   // Enable optimizations. HEAL performs better. However, functions get inlined (specially new/delete operators).
-#   // This behaviour is disabled by default, since you may get wrong stacktraces.
-#   ifdef _MSC_VER
-#       pragma optimize( "gsy", on )        // enable optimizations on msvc
-#   else
-#       pragma GCC optimize                 // enable optimizations on gcc 4.4+
-#       pragma optimize                     // enable optimizations on a few other compilers, hopefully
-#   endif
-#endif
-
-std::string demangle( const std::string &mangled ) {
-    $apple({
-        std::stringstream ss;
-        if( !(ss << mangled) )
-            return mangled;
-        std::string number, filename, address, funcname, plus, offset;
-        if( !(ss >> number >> filename >> address >> funcname >> plus >> offset) )
-            return mangled;
-        int status = 0;
-        char *demangled = abi::__cxa_demangle(funcname.c_str(), NULL, NULL, &status);
-        heal::sfstring out;
-        if( status == 0 && demangled ) {
-            out = std::string() + demangled + " ([" + filename + "]:" + offset + ")";
-        } else {
-            out = std::string() + funcname  + " ([" + filename + "]:" + offset + ")";
-        }
-        if( demangled ) free( demangled );
-        return out;
-    })
-    $linux({
-        $no( /* c++filt way */
-        FILE *fp = popen( (std::string("echo -n \"") + mangled + std::string("\" | c++filt" )).c_str(), "r" );
-        if (!fp) { return mangled; }
-        char demangled[1024];
-        char *line_p = fgets(demangled, sizeof(demangled), fp);
-        pclose(fp);
-        return demangled;
-        )
-        $yes( /* addr2line way. wip & quick proof-of-concept. clean up required. */
-        heal::sfstring binary = mangled.substr( 0, mangled.find_first_of('(') );
-        heal::sfstring address = mangled.substr( mangled.find_last_of('[') + 1 );
-        address.pop_back();
-        heal::sfstring cmd( "addr2line -e \1 \2", binary, address );
-        FILE *fp = popen( cmd.c_str(), "r" );
-        if (!fp) { return mangled; }
-        char demangled[1024];
-        char *line_p = fgets(demangled, sizeof(demangled), fp);
-        pclose(fp);
-        heal::sfstring demangled_(demangled);
-        if( demangled_.size() ) demangled_.pop_back(); //remove \n
-        return demangled_.size() && demangled_.at(0) == '?' ? mangled : demangled_;
-        )
-    })
-    $windows({
-        char demangled[1024];
-        return (UnDecorateSymbolName(mangled.c_str(), demangled, sizeof( demangled ), UNDNAME_COMPLETE)) ? std::string(demangled) : mangled;
-    })
-    /*
-    $gnuc({
-        std::string out;
-        int status = 0;
-        char *demangled = abi::__cxa_demangle(mangled.c_str(), 0, 0, &status);
-        out = ( status == 0 && demangled ? std::string(demangled) : mangled );
-        if( demangled ) free( demangled );
-        return out;
-    })
-    */
-        return mangled;
-}
+// SYMBOLIZER
+// In-process ELF/DWARF symbolizer. Every loaded object is mapped once, its symbol tables and
+// .debug_line programs get indexed, and each later lookup is just a couple of binary searches.
+// No child processes are spawned, except for the addr2line helper pool below, which is only a fallback.
 
-// CALLSTACK
+#if $on($linux)
 
+namespace {
 
-        callstack::callstack( bool autosave ) {
-            if( autosave ) save();
+    struct mapped_file {
+        const unsigned char *data;
+        size_t size;
+
+        mapped_file( const std::string &pathfile ) : data(0), size(0) {
+            int fd = open( pathfile.c_str(), O_RDONLY | O_CLOEXEC );
+            if( fd < 0 ) return;
+            struct stat st;
+            if( fstat( fd, &st ) == 0 && st.st_size > 0 ) {
+                void *ptr = mmap( 0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+                if( ptr != MAP_FAILED ) {
+                    data = (const unsigned char *)ptr;
+                    size = st.st_size;
+                }
+            }
+            close( fd );
         }
-
-        size_t callstack::space() const {
-            return sizeof(frames) + sizeof(void *) * frames.size();
+        ~mapped_file() {
+            if( data ) munmap( (void *)data, size );
         }
 
-        void callstack::save( unsigned frames_to_skip ) {
-
-            if( frames_to_skip > max_frames )
-                return;
+        private: mapped_file( const mapped_file & ); mapped_file &operator=( const mapped_file & );
+    };
 
-            frames.clear();
-            frames.resize( max_frames, (void *)0 );
-            void **out_frames = &frames[0]; // .data();
+    // little cursor over a dwarf section. reads never go past the end.
+    struct dwarf_reader {
+        const unsigned char *at, *end;
 
-            $windows({
-                unsigned short capturedFrames = 0;
+        dwarf_reader( const unsigned char *begin = 0, const unsigned char *end = 0 ) : at(begin), end(end)
+        {}
+        bool ok() const { return at && at < end; }
+        template<typename T> T fixed() {
+            T t = T();
+            if( at + sizeof(T) > end ) return at = end, t;
+            return std::memcpy( &t, at, sizeof(T) ), at += sizeof(T), t;
+        }
+        uint64_t uleb() {
+            uint64_t v = 0; unsigned shift = 0;
+            while( at < end ) {
+                unsigned char b = *at++;
+                if( shift < 64 ) v |= uint64_t(b & 0x7f) << shift;
+                shift += 7;
+                if( !(b & 0x80) ) break;
+            }
+            return v;
+        }
+        int64_t sleb() {
+            int64_t v = 0; unsigned shift = 0; unsigned char b = 0;
+            while( at < end ) {
+                b = *at++;
+                if( shift < 64 ) v |= int64_t(b & 0x7f) << shift;
+                shift += 7;
+                if( !(b & 0x80) ) break;
+            }
+            if( shift < 64 && (b & 0x40) ) v |= -(int64_t(1) << shift);
+            return v;
+        }
+        uint64_t offset( bool dwarf64 ) {
+            return dwarf64 ? fixed<uint64_t>() : fixed<uint32_t>();
+        }
+        const char *cstr() {
+            const char *s = (const char *)at;
+            while( at < end && *at ) ++at;
+            if( at < end ) return ++at, s;
+            return "";
+        }
+        void skip( uint64_t n ) {
+            at = ( n > uint64_t(end - at) ? end : at + n );
+        }
+    };
+
+    struct elf_symbol {
+        uint64_t addr, size;
+        const char *name;
+        bool operator<( const elf_symbol &other ) const { return addr < other.addr; }
+    };
+
+    struct line_row {
+        uint64_t addr;
+        uint32_t file, line; // line 0: compiler-generated code with no source line
+        bool end_sequence;
+        // a sequence may start where another one ends: the end marker goes first, so lookups land on the new row
+        bool operator<( const line_row &other ) const { return addr < other.addr || ( addr == other.addr && end_sequence > other.end_sequence ); }
+    };
+
+    // parsed & indexed contents of a single ELF file (plus its separate debug file, if any)
+    struct elf_image {
+        std::vector< mapped_file * > files;
+        std::vector< elf_symbol > symbols;
+        std::vector< line_row > rows;
+        std::vector< std::string > filenames;
+        std::string build_id;
+
+        elf_image( const std::string &pathfile ) {
+            sections sec;
+            if( !load( pathfile, sec ) ) return;
+            if( !sec.debug_line.ok() && !build_id.empty() ) {
+                // try /usr/lib/debug/.build-id/xx/yyyy.debug
+                sections dbg;
+                if( load( "/usr/lib/debug/.build-id/" + build_id.substr(0,2) + "/" + build_id.substr(2) + ".debug", dbg ) ) {
+                    if( symbols.empty() ) index_symbols( dbg );
+                    sec.debug_line = dbg.debug_line, sec.debug_str = dbg.debug_str, sec.debug_line_str = dbg.debug_line_str;
+                }
+            }
+            if( symbols.empty() ) index_symbols( sec );
+            index_lines( sec );
+        }
+        ~elf_image() {
+            for( size_t i = 0; i < files.size(); ++i ) delete files[i];
+        }
+
+        bool resolve( uint64_t addr, std::string &func, std::string &file, unsigned &line ) const {
+            func.clear(), file.clear(), line = 0;
+            uint64_t call = addr ? addr - 1 : 0;
+            std::vector<elf_symbol>::const_iterator s = std::upper_bound( symbols.begin(), symbols.end(), elf_symbol { addr, 0, 0 } );
+            if( s != symbols.begin() ) {
+                --s;
+                if( addr < s->addr + s->size || !s->size ) func = demangle_symbol( s->name );
+                if( addr == s->addr ) call = addr; // function entry (ie, lookup()), not a return address
+            }
+            // return addresses point past the call; look the call itself up instead
+            std::vector<line_row>::const_iterator r = std::upper_bound( rows.begin(), rows.end(), line_row { call, 0, 0, false } );
+            if( r != rows.begin() && !(--r)->end_sequence && r->line && r->file < filenames.size() ) {
+                file = filenames[ r->file ];
+                line = r->line;
+            }
+            return !func.empty() || line;
+        }
+
+        private:
+
+        struct sections {
+            dwarf_reader symtab, strtab, dynsym, dynstr, debug_line, debug_str, debug_line_str;
+        };
+
+        static std::string demangle_symbol( const char *name ) {
+            int status = 0;
+            char *demangled = abi::__cxa_demangle( name, 0, 0, &status );
+            std::string out( status == 0 && demangled ? demangled : name );
+            if( demangled ) free( demangled );
+            return out;
+        }
+
+        bool load( const std::string &pathfile, sections &sec ) {
+            mapped_file *mf = new mapped_file( pathfile );
+            const unsigned char *base = mf->data;
+            if( !base || mf->size < sizeof(ElfW(Ehdr)) || std::memcmp( base, ELFMAG, SELFMAG ) ) {
+                delete mf;
+                return false;
+            }
+            files.push_back( mf );
+
+            const ElfW(Ehdr) *eh = (const ElfW(Ehdr) *)base;
+            if( eh->e_shoff == 0 || eh->e_shoff + eh->e_shnum * sizeof(ElfW(Shdr)) > mf->size || eh->e_shstrndx >= eh->e_shnum )
+                return true;
+
+            const ElfW(Shdr) *sh = (const ElfW(Shdr) *)( base + eh->e_shoff );
+            const char *names = (const char *)( base + sh[ eh->e_shstrndx ].sh_offset );
+
+            for( unsigned i = 0; i < eh->e_shnum; ++i ) {
+                if( sh[i].sh_type == SHT_NOBITS || sh[i].sh_offset + sh[i].sh_size > mf->size ) continue;
+                if( sh[i].sh_flags & SHF_COMPRESSED ) continue; // @todo: zlib compressed debug sections
+                dwarf_reader rd( base + sh[i].sh_offset, base + sh[i].sh_offset + sh[i].sh_size );
+                const char *name = names + sh[i].sh_name;
+                /**/ if( sh[i].sh_type == SHT_SYMTAB ) sec.symtab = rd, sec.strtab = section_at( base, sh, eh->e_shnum, sh[i].sh_link, mf->size );
+                else if( sh[i].sh_type == SHT_DYNSYM ) sec.dynsym = rd, sec.dynstr = section_at( base, sh, eh->e_shnum, sh[i].sh_link, mf->size );
+                else if( !strcmp( name, ".debug_line" ) ) sec.debug_line = rd;
+                else if( !strcmp( name, ".debug_str" ) ) sec.debug_str = rd;
+                else if( !strcmp( name, ".debug_line_str" ) ) sec.debug_line_str = rd;
+                else if( sh[i].sh_type == SHT_NOTE && build_id.empty() ) build_id = read_build_id( rd );
+            }
+            return true;
+        }
+
+        static dwarf_reader section_at( const unsigned char *base, const ElfW(Shdr) *sh, unsigned count, unsigned index, size_t size ) {
+            if( index >= count || sh[index].sh_offset + sh[index].sh_size > size ) return dwarf_reader();
+            return dwarf_reader( base + sh[index].sh_offset, base + sh[index].sh_offset + sh[index].sh_size );
+        }
+
+        public:
+
+        static std::string read_build_id( dwarf_reader rd ) {
+            std::string build_id;
+            while( rd.ok() ) {
+                uint32_t namesz = rd.fixed<uint32_t>(), descsz = rd.fixed<uint32_t>(), type = rd.fixed<uint32_t>();
+                const unsigned char *name = rd.at, *desc = rd.at + ((namesz + 3) & ~3u);
+                rd.skip( ((namesz + 3) & ~3u) + ((descsz + 3) & ~3u) );
+                if( type == NT_GNU_BUILD_ID && namesz == 4 && !std::memcmp( name, "GNU", 4 ) && desc + descsz <= rd.end ) {
+                    static const char hex[] = "0123456789abcdef";
+                    for( uint32_t i = 0; i < descsz; ++i ) build_id += hex[ desc[i] >> 4 ], build_id += hex[ desc[i] & 15 ];
+                    break;
+                }
+            }
+            return build_id;
+        }
+
+        private:
+
+        void index_symbols( const sections &sec ) {
+            const dwarf_reader *tabs[][2] = { { &sec.symtab, &sec.strtab }, { &sec.dynsym, &sec.dynstr } };
+            for( unsigned t = 0; t < 2 && symbols.empty(); ++t ) {
+                dwarf_reader syms = *tabs[t][0], strs = *tabs[t][1];
+                if( !syms.ok() || !strs.ok() ) continue;
+                for( const ElfW(Sym) *s = (const ElfW(Sym) *)syms.at; (const unsigned char *)(s + 1) <= syms.end; ++s ) {
+                    if( ELF64_ST_TYPE( s->st_info ) != STT_FUNC || !s->st_value || s->st_shndx == SHN_UNDEF ) continue;
+                    if( s->st_name >= size_t(strs.end - strs.at) ) continue;
+                    elf_symbol sym = { s->st_value, s->st_size, (const char *)strs.at + s->st_name };
+                    symbols.push_back( sym );
+                }
+            }
+            std::stable_sort( symbols.begin(), symbols.end() );
+        }
+
+        static const char *form_string( dwarf_reader &rd, uint64_t form, bool dwarf64, const sections &sec ) {
+            switch( form ) {
+                case 0x08: /* DW_FORM_string */ return rd.cstr();
+                case 0x0e: /* DW_FORM_strp */
+                case 0x1f: { /* DW_FORM_line_strp */
+                    uint64_t off = rd.offset( dwarf64 );
+                    dwarf_reader str = ( form == 0x0e ? sec.debug_str : sec.debug_line_str );
+                    return str.ok() && off < uint64_t(str.end - str.at) ? (const char *)str.at + off : "";
+                }
+            }
+            return 0;
+        }
+
+        static uint64_t form_value( dwarf_reader &rd, uint64_t form, bool dwarf64 ) {
+            switch( form ) {
+                case 0x0b: return rd.fixed<uint8_t>();   // DW_FORM_data1
+                case 0x05: return rd.fixed<uint16_t>();  // DW_FORM_data2
+                case 0x06: return rd.fixed<uint32_t>();  // DW_FORM_data4
+                case 0x07: return rd.fixed<uint64_t>();  // DW_FORM_data8
+                case 0x0f: return rd.uleb();             // DW_FORM_udata
+                case 0x1e: return rd.skip(16), 0;        // DW_FORM_data16
+                case 0x09: return rd.skip( rd.uleb() ), 0; // DW_FORM_block
+                case 0x0e: case 0x1f: return rd.offset( dwarf64 );
+                case 0x08: return rd.cstr(), 0;
+            }
+            return rd.at = rd.end, 0;                    // unsupported; abort this unit
+        }
+
+        static std::string join( const std::string &dir, const std::string &file ) {
+            if( file.empty() || file[0] == '/' || dir.empty() ) return file;
+            return dir[ dir.size() - 1 ] == '/' ? dir + file : dir + "/" + file;
+        }
+
+        void index_lines( const sections &sec ) {
+            dwarf_reader all = sec.debug_line;
+            while( all.ok() ) {
+                uint64_t unit_length = all.fixed<uint32_t>();
+                bool dwarf64 = ( unit_length == 0xffffffff );
+                if( dwarf64 ) unit_length = all.fixed<uint64_t>();
+                if( unit_length > uint64_t(all.end - all.at) ) break;
+                dwarf_reader unit( all.at, all.at + unit_length );
+                all.skip( unit_length );
+
+                uint16_t version = unit.fixed<uint16_t>();
+                if( version < 2 || version > 5 ) continue;
+                if( version >= 5 ) unit.skip( 2 ); // address_size, segment_selector_size
+                uint64_t header_length = unit.offset( dwarf64 );
+                dwarf_reader program( unit.at + ( header_length < uint64_t(unit.end - unit.at) ? header_length : 0 ), unit.end );
+                uint8_t min_inst_length = unit.fixed<uint8_t>();
+                if( version >= 4 ) unit.fixed<uint8_t>(); // maximum_operations_per_instruction
+                unit.fixed<uint8_t>(); // default_is_stmt
+                int8_t line_base = unit.fixed<int8_t>();
+                uint8_t line_range = unit.fixed<uint8_t>();
+                uint8_t opcode_base = unit.fixed<uint8_t>();
+                if( !line_range || !opcode_base ) continue;
+                std::vector<uint8_t> opcode_lengths( opcode_base, 0 );
+                for( unsigned i = 1; i < opcode_base; ++i ) opcode_lengths[i] = unit.fixed<uint8_t>();
+
+                // directories & files. files get remapped into our module-wide filename table.
+                std::vector<std::string> dirs;
+                std::vector<uint32_t> unit_files;
+                if( version < 5 ) {
+                    dirs.push_back( std::string() );
+                    for( const char *dir; *(dir = unit.cstr()); ) dirs.push_back( dir );
+                    unit_files.push_back( 0 ); // 1-based
+                    for( const char *name; unit.ok() && *(name = unit.cstr()); ) {
+                        uint64_t dir = unit.uleb(); unit.uleb(); unit.uleb();
+                        unit_files.push_back( intern_filename( join( dir < dirs.size() ? dirs[dir] : std::string(), name ) ) );
+                    }
+                } else {
+                    for( unsigned pass = 0; pass < 2; ++pass ) {
+                        uint8_t format_count = unit.fixed<uint8_t>();
+                        std::vector< std::pair<uint64_t, uint64_t> > format( format_count );
+                        for( unsigned i = 0; i < format_count; ++i ) format[i].first = unit.uleb(), format[i].second = unit.uleb();
+                        uint64_t count = unit.uleb();
+                        for( uint64_t n = 0; n < count && unit.ok(); ++n ) {
+                            std::string path; uint64_t dir = 0;
+                            for( unsigned i = 0; i < format_count; ++i ) {
+                                if( format[i].first == 1 /* DW_LNCT_path */ ) {
+                                    const char *s = form_string( unit, format[i].second, dwarf64, sec );
+                                    if( !s ) { unit.at = unit.end; break; }
+                                    path = s;
+                                }
+                                else if( format[i].first == 2 /* DW_LNCT_directory_index */ ) dir = form_value( unit, format[i].second, dwarf64 );
+                                else form_value( unit, format[i].second, dwarf64 );
+                            }
+                            if( pass == 0 ) dirs.push_back( path );
+                            else unit_files.push_back( intern_filename( join( dir < dirs.size() ? dirs[dir] : std::string(), path ) ) );
+                        }
+                    }
+                }
+
+                // run the line number program
+                uint64_t address = 0; uint32_t file = 1, line = 1;
+                if( version >= 5 ) file = 0;
+                while( program.ok() ) {
+                    uint8_t op = program.fixed<uint8_t>();
+                    if( op >= opcode_base ) {
+                        unsigned adjusted = op - opcode_base;
+                        address += ( adjusted / line_range ) * min_inst_length;
+                        line += line_base + int( adjusted % line_range );
+                        emit( address, unit_files, file, line );
+                        continue;
+                    }
+                    switch( op ) {
+                        case 0: {
+                            uint64_t len = program.uleb();
+                            const unsigned char *next = program.at + ( len < uint64_t(program.end - program.at) ? len : program.end - program.at );
+                            uint8_t sub = len ? program.fixed<uint8_t>() : 0;
+                            if( sub == 1 ) { // DW_LNE_end_sequence
+                                line_row row = { address, 0, 0, true };
+                                rows.push_back( row );
+                                address = 0, file = ( version >= 5 ? 0 : 1 ), line = 1;
+                            }
+                            else if( sub == 2 ) address = ( len - 1 == 8 ? program.fixed<uint64_t>() : program.fixed<uint32_t>() );
+                            program.at = next;
+                            break;
+                        }
+                        case 1: emit( address, unit_files, file, line ); break;                 // DW_LNS_copy
+                        case 2: address += program.uleb() * min_inst_length; break;           // DW_LNS_advance_pc
+                        case 3: line += int( program.sleb() ); break;                         // DW_LNS_advance_line
+                        case 4: file = uint32_t( program.uleb() ); break;                     // DW_LNS_set_file
+                        case 8: address += ( ( 255 - opcode_base ) / line_range ) * min_inst_length; break; // DW_LNS_const_add_pc
+                        case 9: address += program.fixed<uint16_t>(); break;                  // DW_LNS_fixed_advance_pc
+                        default:
+                            for( unsigned i = 0; i < opcode_lengths[op]; ++i ) program.uleb();
+                    }
+                }
+            }
+            std::stable_sort( rows.begin(), rows.end() );
+        }
+
+        std::map<std::string, uint32_t> filename_index;
+        uint32_t intern_filename( const std::string &name ) {
+            std::map<std::string, uint32_t>::iterator it = filename_index.find( name );
+            if( it != filename_index.end() ) return it->second;
+            filenames.push_back( name );
+            return filename_index[ name ] = uint32_t( filenames.size() - 1 );
+        }
+
+        void emit( uint64_t address, const std::vector<uint32_t> &unit_files, uint32_t file, uint32_t line ) {
+            line_row row = { address, file < unit_files.size() ? unit_files[file] : ~0u, line, false };
+            rows.push_back( row );
+        }
+
+        elf_image( const elf_image & ); elf_image &operator=( const elf_image & );
+    };
+
+    // symbolizer backends. each one resolves a batch of module-relative offsets of a single binary.
+    // backends are chained: whatever a backend leaves empty is tried with the next one.
+
+    std::string format_symbol( const std::string &func, const std::string &file, unsigned line ) {
+        if( !line ) return func;
+        return heal::sfstring( "\1 (\2:\3)", func.empty() ? std::string("????") : func, file, line );
+    }
+
+    struct symbolizer_backend {
+        virtual ~symbolizer_backend() {}
+        virtual const char *name() const = 0;
+        virtual void resolve( const std::string &binary, const std::vector<uint64_t> &offsets, std::vector<std::string> &out ) = 0;
+    };
+
+    // in-process, see elf_image above
+    struct dwarf_backend : public symbolizer_backend {
+        std::map< std::string, elf_image * > images;
+
+        ~dwarf_backend() {
+            for( std::map<std::string, elf_image *>::iterator it = images.begin(); it != images.end(); ++it )
+                delete it->second;
+        }
+        const char *name() const {
+            return "dwarf";
+        }
+        elf_image &image( const std::string &binary ) {
+            elf_image *&image = images[ binary ];
+            if( !image ) image = new elf_image( binary );
+            return *image;
+        }
+        void resolve( const std::string &binary, const std::vector<uint64_t> &offsets, std::vector<std::string> &out ) {
+            elf_image &img = image( binary );
+            std::string func, file; unsigned line;
+            for( size_t i = 0; i < offsets.size(); ++i ) {
+                if( out[i].empty() && img.resolve( offsets[i], func, file, line ) )
+                    out[i] = format_symbol( func, file, line );
+            }
+        }
+    };
+
+    // one long-lived `addr2line -a -f -C -i` helper per binary, fed over a socketpair.
+    // a batch costs one round-trip per module. helpers that crash, hang or time out get killed
+    // and respawned on next request. binaries whose helper keeps dying are given up on.
+
+    #ifndef HEAL_ADDR2LINE_TIMEOUT_MS
+    #define HEAL_ADDR2LINE_TIMEOUT_MS 2000
+    #endif
+
+    struct addr2line_backend : public symbolizer_backend {
+        enum { max_helpers = 16, max_restarts = 3 };
+
+        struct helper {
+            pid_t pid;
+            int fd;
+            unsigned restarts;
+            std::string pending;
+            helper() : pid(-1), fd(-1), restarts(0)
+            {}
+        };
+        std::map< std::string, helper > helpers;
+
+        ~addr2line_backend() {
+            for( std::map<std::string, helper>::iterator it = helpers.begin(); it != helpers.end(); ++it )
+                stop( it->second );
+        }
+        const char *name() const {
+            return "addr2line";
+        }
+
+        static void stop( helper &h ) {
+            if( h.fd >= 0 ) close( h.fd );
+            if( h.pid > 0 ) kill( h.pid, SIGKILL ), waitpid( h.pid, 0, 0 );
+            h.fd = h.pid = -1;
+            h.pending.clear();
+        }
+
+        static bool start( helper &h, const std::string &binary ) {
+            int sv[2];
+            if( socketpair( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv ) != 0 ) return false;
+            const char *argv[] = { "addr2line", "-a", "-f", "-C", "-i", "-e", binary.c_str(), 0 };
+            pid_t pid = fork();
+            if( pid == 0 ) {
+                // child: async-signal-safe calls only until exec
+                int null = open( "/dev/null", O_WRONLY );
+                dup2( sv[1], 0 ), dup2( sv[1], 1 );
+                if( null >= 0 ) dup2( null, 2 );
+                execvp( argv[0], (char **)argv );
+                _exit( 127 );
+            }
+            close( sv[1] );
+            if( pid < 0 ) return close( sv[0] ), false;
+            h.pid = pid, h.fd = sv[0];
+            return true;
+        }
+
+        // read a line, waiting at most until deadline
+        static bool getline( helper &h, std::string &line, const std::chrono::steady_clock::time_point &deadline ) {
+            for(;;) {
+                std::string::size_type eol = h.pending.find('\n');
+                if( eol != std::string::npos ) {
+                    line = h.pending.substr( 0, eol );
+                    h.pending.erase( 0, eol + 1 );
+                    return true;
+                }
+                int ms = int( std::chrono::duration_cast<std::chrono::milliseconds>( deadline - std::chrono::steady_clock::now() ).count() );
+                struct pollfd pfd = { h.fd, POLLIN, 0 };
+                if( ms <= 0 || poll( &pfd, 1, ms ) <= 0 ) return false;
+                char buf[4096];
+                ssize_t len = read( h.fd, buf, sizeof(buf) );
+                if( len <= 0 ) return false;
+                h.pending.append( buf, len );
+            }
+        }
+
+        static bool send( helper &h, const std::string &request ) {
+            for( size_t sent = 0; sent < request.size(); ) {
+                ssize_t len = ::send( h.fd, request.data() + sent, request.size() - sent, MSG_NOSIGNAL );
+                if( len <= 0 ) return false;
+                sent += len;
+            }
+            return true;
+        }
+
+        static bool query( helper &h, const std::vector<uint64_t> &offsets, std::vector<std::string> &out ) {
+            // addresses, plus a trailing 0 sentinel so we know when the batch is over
+            std::string request;
+            char buf[32];
+            for( size_t i = 0; i < offsets.size(); ++i ) {
+                sprintf( buf, "0x%" PRIx64 "\n", offsets[i] );
+                request += buf;
+            }
+            request += "0\n";
+            if( !send( h, request ) ) return false;
+
+            // -a prints "0x<addr>" before each answer, then func/file:line pairs (several if inlined)
+            std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds( HEAL_ADDR2LINE_TIMEOUT_MS );
+            std::vector<std::string> answers( offsets.size() + 1 );
+            std::string line, func;
+            size_t index = 0, lines = 0;
+            for( bool header = false; !( index == offsets.size() + 1 && header && lines == 2 ); ) {
+                if( !getline( h, line, deadline ) ) return false;
+                if( line.compare( 0, 2, "0x" ) == 0 ) {
+                    if( header ) ++index;
+                    if( index > offsets.size() ) return false;
+                    header = true, lines = 0;
+                    if( index == offsets.size() ) index++; // sentinel
+                    continue;
+                }
+                if( !header ) continue;
+                if( ++lines % 2 ) { func = line; continue; }
+                if( index >= offsets.size() ) continue;
+                std::string::size_type colon = line.find_last_of(':');
+                unsigned lineno = colon == std::string::npos ? 0 : unsigned( std::strtoul( line.c_str() + colon + 1, 0, 10 ) );
+                std::string file = line.substr( 0, colon );
+                if( func == "??" && !lineno ) continue;
+                std::string symbol = format_symbol( func == "??" ? std::string() : func, file, lineno );
+                answers[index] += answers[index].empty() ? symbol : " [inlined into " + symbol + "]";
+            }
+            for( size_t i = 0; i < offsets.size(); ++i )
+                if( out[i].empty() ) out[i] = answers[i];
+            return true;
+        }
+
+        void resolve( const std::string &binary, const std::vector<uint64_t> &offsets, std::vector<std::string> &out ) {
+            if( helpers.size() >= max_helpers && helpers.find( binary ) == helpers.end() ) {
+                stop( helpers.begin()->second );
+                helpers.erase( helpers.begin() );
+            }
+            helper &h = helpers[ binary ];
+            while( h.restarts < max_restarts ) {
+                if( h.fd < 0 && !start( h, binary ) ) break;
+                if( query( h, offsets, out ) ) return;
+                stop( h );
+                h.restarts++;
+            }
+        }
+    };
+
+    struct loaded_module {
+        std::string path, build_id;
+        uintptr_t bias, lo, hi;
+    };
+
+    struct symbolizer {
+        std::mutex mutex;
+        std::vector< loaded_module > modules;
+        std::vector< symbolizer_backend * > backends, chain;
+
+        symbolizer() {
+            backends.push_back( new dwarf_backend );
+            backends.push_back( new addr2line_backend );
+            chain = backends;
+        }
+        ~symbolizer() {
+            for( size_t i = 0; i < backends.size(); ++i ) delete backends[i];
+        }
+
+        // real path, since "/proc/self/exe" means something else to a helper process
+        static std::string executable() {
+            char buf[4096];
+            ssize_t len = readlink( "/proc/self/exe", buf, sizeof(buf) - 1 );
+            return len > 0 ? std::string( buf, len ) : std::string( "/proc/self/exe" );
+        }
+
+        static int collect( struct dl_phdr_info *info, size_t, void *data ) {
+            std::vector< loaded_module > &out = *(std::vector< loaded_module > *)data;
+            loaded_module m;
+            m.path = ( info->dlpi_name && info->dlpi_name[0] ? info->dlpi_name : executable() );
+            m.bias = info->dlpi_addr, m.lo = ~uintptr_t(0), m.hi = 0;
+            for( int i = 0; i < info->dlpi_phnum; ++i ) {
+                if( info->dlpi_phdr[i].p_type == PT_NOTE && m.build_id.empty() ) {
+                    const unsigned char *note = (const unsigned char *)( m.bias + info->dlpi_phdr[i].p_vaddr );
+                    m.build_id = elf_image::read_build_id( dwarf_reader( note, note + info->dlpi_phdr[i].p_memsz ) );
+                }
+                if( info->dlpi_phdr[i].p_type != PT_LOAD ) continue;
+                uintptr_t lo = m.bias + info->dlpi_phdr[i].p_vaddr;
+                uintptr_t hi = lo + info->dlpi_phdr[i].p_memsz;
+                m.lo = (std::min)( m.lo, lo ), m.hi = (std::max)( m.hi, hi );
+            }
+            if( m.lo < m.hi ) out.push_back( m );
+            return 0;
+        }
+
+        void refresh() {
+            modules.clear();
+            dl_iterate_phdr( &symbolizer::collect, &modules );
+        }
+
+        void invalidate() {
+            std::lock_guard<std::mutex> lock( mutex );
+            modules.clear();
+        }
+
+        bool select( const std::string &names ) {
+            std::lock_guard<std::mutex> lock( mutex );
+            std::vector< symbolizer_backend * > selected;
+            std::stringstream ss( names );
+            for( std::string name; std::getline( ss, name, ',' ); ) {
+                size_t i = 0;
+                while( i < backends.size() && name != backends[i]->name() ) ++i;
+                if( i == backends.size() ) return false;
+                selected.push_back( backends[i] );
+            }
+            return chain = selected, true;
+        }
+
+        // index into modules, or modules.size() if no module has the address
+        size_t find( uintptr_t addr ) const {
+            size_t i = 0;
+            while( i < modules.size() && !( addr >= modules[i].lo && addr < modules[i].hi ) ) ++i;
+            return i;
+        }
+
+        // "module+0xoffset" for a frame no backend could name. the offset is file relative, as addr2line wants it
+        std::string locate( const void *addr ) {
+            std::lock_guard<std::mutex> lock( mutex );
+            size_t m = find( (uintptr_t)addr );
+            if( m == modules.size() ) return std::string();
+            char buf[32];
+            sprintf( buf, "+0x%" PRIxPTR, (uintptr_t)addr - modules[m].bias );
+            return modules[m].path + buf;
+        }
+
+        // frames get grouped by module, so every backend sees one batch per binary
+        void resolve( const void * const *frames, size_t num_frames, std::string *out ) {
+            std::lock_guard<std::mutex> lock( mutex );
+            for( size_t i = 0; i < num_frames; ++i ) {
+                if( find( (uintptr_t)frames[i] ) == modules.size() ) {
+                    refresh(); // new library, maybe. once per call, and before any module gets referenced
+                    break;
+                }
+            }
+            std::map< size_t, std::vector<size_t> > groups;
+            for( size_t i = 0; i < num_frames; ++i ) {
+                size_t m = find( (uintptr_t)frames[i] );
+                if( m < modules.size() ) groups[ m ].push_back( i );
+            }
+            for( std::map< size_t, std::vector<size_t> >::iterator it = groups.begin(); it != groups.end(); ++it ) {
+                const loaded_module &m = modules[ it->first ];
+                const std::vector<size_t> &index = it->second;
+                std::vector<uint64_t> offsets( index.size() );
+                std::vector<std::string> symbols( index.size() );
+                for( size_t i = 0; i < index.size(); ++i ) offsets[i] = (uintptr_t)frames[ index[i] ] - m.bias;
+                resolve_unlocked( m.path, offsets, symbols );
+                for( size_t i = 0; i < index.size(); ++i ) out[ index[i] ] = symbols[i];
+            }
+        }
+
+        // offline flavor: offsets are relative to the binary, which does not need to be loaded
+        void resolve( const std::string &binary, const std::vector<uint64_t> &offsets, std::vector<std::string> &out ) {
+            std::lock_guard<std::mutex> lock( mutex );
+            resolve_unlocked( binary, offsets, out );
+        }
+
+        std::string build_id( const std::string &binary ) {
+            std::lock_guard<std::mutex> lock( mutex );
+            return ((dwarf_backend *)backends[0])->image( binary ).build_id;
+        }
+
+        private:
+
+        void resolve_unlocked( const std::string &binary, const std::vector<uint64_t> &offsets, std::vector<std::string> &out ) {
+            out.resize( offsets.size() );
+            for( size_t b = 0; b < chain.size(); ++b ) {
+                chain[b]->resolve( binary, offsets, out );
+                if( std::find( out.begin(), out.end(), std::string() ) == out.end() ) break;
+            }
+        }
+    };
+
+    // loaded modules as the unwinder sees them: address range and .eh_frame_hdr of each, readable from signal
+    // handlers without the loader's lock. rewrites are serialized and bump a sequence counter twice, so it is
+    // odd while one is in flight; the sequence doubles as the module generation every cache keys on.
+    // dlopen() and dlclose() are wrapped (see LOADER HOOKS) to rewrite it. loads the wrappers never see, like
+    // glibc's own for NSS or iconv, are caught by sync_modules() from the loader's counters.
+    #ifndef HEAL_MAX_MODULES
+    #define HEAL_MAX_MODULES 512
+    #endif
+
+    struct module_table {
+        struct range {
+            std::atomic<uintptr_t> lo, hi, eh_frame_hdr;
+        } ranges[ HEAL_MAX_MODULES ];
+        std::atomic<unsigned> count;
+        std::atomic<uint64_t> sequence, loader_counts; // loader_counts: dlpi_adds + dlpi_subs at the last rewrite
+        std::atomic<int> unloading, readers;            // dlclose() calls in flight; lookups reading module memory
+    };
+    module_table loaded_modules; // zero-initialized static storage
+    std::mutex module_table_mutex;
+
+    // lock-free; fine anywhere
+    inline uint64_t module_generation() {
+        return loaded_modules.sequence.load( std::memory_order_acquire );
+    }
+
+    int count_loads( struct dl_phdr_info *info, size_t size, void *data ) {
+        if( size >= offsetof( struct dl_phdr_info, dlpi_subs ) + sizeof( info->dlpi_subs ) )
+            *(uint64_t *)data = uint64_t( info->dlpi_adds ) + uint64_t( info->dlpi_subs );
+        return 1;
+    }
+
+    int collect_range( struct dl_phdr_info *info, size_t size, void *data ) {
+        unsigned &n = *(unsigned *)data;
+        if( !n ) {
+            uint64_t counts = 0;
+            count_loads( info, size, &counts );
+            loaded_modules.loader_counts.store( counts );
+        }
+        uintptr_t lo = ~uintptr_t(0), hi = 0, hdr = 0;
+        for( int i = 0; i < info->dlpi_phnum; ++i ) {
+            const ElfW(Phdr) &ph = info->dlpi_phdr[i];
+            if( ph.p_type == PT_LOAD )
+                lo = (std::min)( lo, uintptr_t( info->dlpi_addr + ph.p_vaddr ) ), hi = (std::max)( hi, uintptr_t( info->dlpi_addr + ph.p_vaddr + ph.p_memsz ) );
+            if( ph.p_type == PT_GNU_EH_FRAME ) hdr = info->dlpi_addr + ph.p_vaddr;
+        }
+        if( lo < hi && n < HEAL_MAX_MODULES ) {
+            module_table::range &r = loaded_modules.ranges[ n++ ];
+            r.lo.store( lo, std::memory_order_relaxed );
+            r.hi.store( hi, std::memory_order_relaxed );
+            r.eh_frame_hdr.store( hdr, std::memory_order_relaxed );
+        }
+        return 0;
+    }
+
+    // rewrite the table from the loader's list. not for signal handlers
+    void rebuild_modules() {
+        std::lock_guard<std::mutex> lock( module_table_mutex );
+        loaded_modules.sequence.fetch_add( 1 ); // odd: readers back off
+        unsigned n = 0;
+        dl_iterate_phdr( &collect_range, &n );
+        loaded_modules.count.store( n, std::memory_order_relaxed );
+        loaded_modules.sequence.fetch_add( 1 );
+    }
+
+    // module generation, after catching up with loads the wrappers missed. takes the loader's lock: not for signal handlers
+    uint64_t sync_modules() {
+        uint64_t counts = 0;
+        dl_iterate_phdr( &count_loads, &counts );
+        if( counts != loaded_modules.loader_counts.load() || !module_generation() ) rebuild_modules();
+        return module_generation();
+    }
+
+    // dlclose() bracket: lookups stop touching module memory, and the table gets rewritten once the library is gone
+    void modules_unloading( bool begin ) {
+        if( begin ) {
+            loaded_modules.unloading.fetch_add( 1 );
+            while( loaded_modules.readers.load() ) std::this_thread::yield();
+        } else {
+            rebuild_modules();
+            loaded_modules.unloading.fetch_sub( 1 );
+        }
+    }
+
+    struct module_table_primer {
+        module_table_primer() { sync_modules(); }
+    } prime_module_table;
+
+    symbolizer &get_symbolizer() {
+        static symbolizer *sym = new symbolizer; // leaked on purpose; may be used from atexit/crash code
+        return *sym;
+    }
+
+    // returns "function (file:line)", "function" or an empty string if unknown
+    std::string symbolize( const void *addr ) {
+        std::string out;
+        get_symbolizer().resolve( &addr, 1, &out );
+        return out;
+    }
+}
+
+#endif
+
+// DEMANGLE
+
+#if 1
+#   // Disable optimizations. Nothing gets inlined. You get pleasant stacktraces to work with.
+#   // This is the default setting.
+#   ifdef _MSC_VER
+#       pragma optimize( "gsy", off )       // disable optimizations on msvc
+#   else
+#       pragma OPTIMIZE OFF                 // disable optimizations on gcc 4.4+
+#   endif
+#else
+#   // Enable optimizations. HEAL performs better. However, functions get inlined (specially new/delete operators).
+#   // This behaviour is disabled by default, since you may get wrong stacktraces.
+#   ifdef _MSC_VER
+#       pragma optimize( "gsy", on )        // enable optimizations on msvc
+#   else
+#       pragma GCC optimize                 // enable optimizations on gcc 4.4+
+#       pragma optimize                     // enable optimizations on a few other compilers, hopefully
+#   endif
+#endif
+
+std::string demangle( const std::string &mangled ) {
+    $apple({
+        std::stringstream ss;
+        if( !(ss << mangled) )
+            return mangled;
+        std::string number, filename, address, funcname, plus, offset;
+        if( !(ss >> number >> filename >> address >> funcname >> plus >> offset) )
+            return mangled;
+        int status = 0;
+        char *demangled = abi::__cxa_demangle(funcname.c_str(), NULL, NULL, &status);
+        heal::sfstring out;
+        if( status == 0 && demangled ) {
+            out = std::string() + demangled + " ([" + filename + "]:" + offset + ")";
+        } else {
+            out = std::string() + funcname  + " ([" + filename + "]:" + offset + ")";
+        }
+        if( demangled ) free( demangled );
+        return out;
+    })
+    $linux({
+        $no( /* c++filt way */
+        FILE *fp = popen( (std::string("echo -n \"") + mangled + std::string("\" | c++filt" )).c_str(), "r" );
+        if (!fp) { return mangled; }
+        char demangled[1024];
+        char *line_p = fgets(demangled, sizeof(demangled), fp);
+        pclose(fp);
+        return demangled;
+        )
+        // symbolizer backends (in-process, then the addr2line helpers). nothing else spawns processes here
+        std::string::size_type bracket = mangled.find_last_of('[');
+        if( bracket != std::string::npos ) {
+            void *addr = (void *)std::strtoull( mangled.c_str() + bracket + 1, 0, 16 );
+            std::string symbol = symbolize( addr );
+            if( !symbol.empty() ) return symbol;
+        }
+        return mangled;
+    })
+    $windows({
+        char demangled[1024];
+        return (UnDecorateSymbolName(mangled.c_str(), demangled, sizeof( demangled ), UNDNAME_COMPLETE)) ? std::string(demangled) : mangled;
+    })
+    /*
+    $gnuc({
+        std::string out;
+        int status = 0;
+        char *demangled = abi::__cxa_demangle(mangled.c_str(), 0, 0, &status);
+        out = ( status == 0 && demangled ? std::string(demangled) : mangled );
+        if( demangled ) free( demangled );
+        return out;
+    })
+    */
+        return mangled;
+}
+
+// UNWINDER
+// Alternatives to glibc's backtrace(), which goes through libgcc and takes the dl_iterate_phdr() lock
+// and parses FDEs on every single call. Both engines below read the stack directly and do not allocate:
+// - framepointer walks the rbp/x29 chain. Fastest, but needs -fno-omit-frame-pointer everywhere.
+// - ehframe interprets .eh_frame CFI. Every row it computes is kept in a lock-free table keyed by pc,
+//   so after warm-up a frame costs a hash probe and two loads.
+
+#if $on($gnuc) && defined(__linux__) && ( defined(__x86_64__) || defined(__aarch64__) )
+#   define $unwinder  $yes
+#else
+#   define $unwinder  $no
+#endif
+
+#if $on($unwinder)
+
+namespace {
+
+    struct unwind_regs {
+        uintptr_t pc, sp, fp;
+    };
+
+    // stack range of current thread. computed once per thread, outside of signal handlers only.
+    struct stack_bounds {
+        uintptr_t lo, hi;
+    };
+    $tls( stack_bounds thread_stack ) = { 0, 0 };
+
+    const stack_bounds &current_stack_bounds() {
+        if( !thread_stack.hi ) {
+            pthread_attr_t attr;
+            void *addr; size_t size;
+            if( pthread_getattr_np( pthread_self(), &attr ) == 0 ) {
+                if( pthread_attr_getstack( &attr, &addr, &size ) == 0 )
+                    thread_stack.lo = (uintptr_t)addr, thread_stack.hi = (uintptr_t)addr + size;
+                pthread_attr_destroy( &attr );
+            }
+        }
+        return thread_stack;
+    }
+
+    // is [addr, addr+len) a sane place to read a saved register from?
+    inline bool readable( uintptr_t addr, uintptr_t sp, const stack_bounds &bounds ) {
+        if( addr & ( sizeof(void *) - 1 ) ) return false;
+        if( bounds.hi ) return addr >= bounds.lo && addr + 2 * sizeof(void *) <= bounds.hi;
+        return addr >= sp && addr - sp < ( 8 << 20 ); // unknown bounds; assume a sane 8 MiB stack
+    }
+
+    unsigned unwind_fp( unwind_regs regs, const stack_bounds &bounds, void **out, unsigned capacity, unsigned skip ) {
+        unsigned depth = 0;
+        for( uintptr_t fp = regs.fp, sp = regs.sp; depth < capacity && readable( fp, sp, bounds ); ) {
+            const uintptr_t *frame = (const uintptr_t *)fp;
+            uintptr_t next = frame[0], ra = frame[1];
+            if( !ra ) break;
+            if( skip ) --skip; else out[ depth++ ] = (void *)ra;
+            if( next <= fp ) break; // stacks grow down; anything else is garbage
+            sp = fp, fp = next;
+        }
+        return depth;
+    }
+
+#if defined(__x86_64__)
+
+    // CFI row: where the CFA is, and where caller's rbp and return address were saved (both CFA relative)
+    struct cfi_row {
+        enum { valid = 1, cfa_is_fp = 2, fp_saved = 4, outermost = 8 };
+        int32_t cfa_offset;
+        int16_t fp_offset, ra_offset;
+        uint32_t flags;
+
+        uint64_t pack() const {
+            return uint64_t( uint32_t( cfa_offset ) ) | uint64_t( uint16_t( fp_offset ) ) << 32 | uint64_t( uint8_t( int8_t( ra_offset ) ) ) << 48 | uint64_t( flags & 0xff ) << 56;
+        }
+        static cfi_row unpack( uint64_t v ) {
+            cfi_row r = { int32_t( uint32_t( v ) ), int16_t( uint16_t( v >> 32 ) ), int16_t( int8_t( uint8_t( v >> 48 ) ) ), uint32_t( v >> 56 ) };
+            return r;
+        }
+    };
+
+    // lock-free table of computed rows. slots are claimed with a CAS and only reused once stale: keys carry the low
+    // 16 bits of the module generation above the 47-bit user address, so a dlopen()/dlclose() retires every row
+    // at once, failed lookups included. when the table is full, rows simply get recomputed on every visit.
+    #ifndef HEAL_CFI_CACHE_SIZE
+    #define HEAL_CFI_CACHE_SIZE 16384
+    #endif
+
+    struct cfi_cache {
+        enum { size = HEAL_CFI_CACHE_SIZE, probes = 8, busy = 1 };
+        struct slot {
+            std::atomic<uintptr_t> pc;
+            std::atomic<uint64_t> row;
+        } slots[ size ];
+
+        static uintptr_t key( uintptr_t pc, uint64_t generation ) {
+            return ( pc & ( ( uintptr_t(1) << 48 ) - 1 ) ) | uintptr_t( generation & 0xffff ) << 48;
+        }
+        static size_t hash( uintptr_t key ) {
+            return size_t( ( ( key & ( ( uintptr_t(1) << 48 ) - 1 ) ) * 0x9E3779B97F4A7C15ull ) >> 40 ) % size;
+        }
+        bool find( uintptr_t key, uint64_t &row ) const {
+            for( size_t i = hash( key ), n = 0; n < probes; ++n, i = ( i + 1 ) % size ) {
+                uintptr_t seen = slots[i].pc.load( std::memory_order_acquire );
+                if( seen == key ) return row = slots[i].row.load( std::memory_order_relaxed ), true;
+                if( !seen ) return false;
+            }
+            return false;
+        }
+        void insert( uintptr_t key, uint64_t row ) {
+            for( size_t i = hash( key ), n = 0; n < probes; ++n, i = ( i + 1 ) % size ) {
+                uintptr_t seen = slots[i].pc.load( std::memory_order_relaxed );
+                if( seen == key ) return;
+                bool stale = seen > busy && ( seen >> 48 ) != ( key >> 48 );
+                if( ( !seen || stale ) && slots[i].pc.compare_exchange_strong( seen, busy, std::memory_order_acquire ) ) {
+                    slots[i].row.store( row, std::memory_order_relaxed );
+                    slots[i].pc.store( key, std::memory_order_release );
+                    return;
+                }
+            }
+        }
+    };
+    cfi_cache cfi_rows; // zero-initialized static storage
+
+    // minimal DW_EH_PE pointer decoding
+    struct eh_reader {
+        const unsigned char *at;
+        uintptr_t datarel;
+
+        template<typename T> T fixed() {
+            T t; std::memcpy( &t, at, sizeof(T) ); at += sizeof(T); return t;
+        }
+        uint64_t uleb() {
+            uint64_t v = 0; unsigned shift = 0; unsigned char b;
+            do { b = *at++; if( shift < 64 ) v |= uint64_t(b & 0x7f) << shift; shift += 7; } while( b & 0x80 );
+            return v;
+        }
+        int64_t sleb() {
+            int64_t v = 0; unsigned shift = 0; unsigned char b;
+            do { b = *at++; if( shift < 64 ) v |= int64_t(b & 0x7f) << shift; shift += 7; } while( b & 0x80 );
+            if( shift < 64 && (b & 0x40) ) v |= -(int64_t(1) << shift);
+            return v;
+        }
+        bool pointer( uint8_t enc, uintptr_t &out ) {
+            if( enc == 0xff ) return out = 0, true; // DW_EH_PE_omit
+            uintptr_t base = ( enc & 0x70 ) == 0x10 ? (uintptr_t)at : ( enc & 0x70 ) == 0x30 ? datarel : 0;
+            if( ( enc & 0x70 ) && !base ) return false;
+            uintptr_t v;
+            switch( enc & 0x0f ) {
+                case 0x00: v = fixed<uintptr_t>(); break;
+                case 0x01: v = uleb(); break;
+                case 0x02: v = fixed<uint16_t>(); break;
+                case 0x03: v = fixed<uint32_t>(); break;
+                case 0x04: v = fixed<uint64_t>(); break;
+                case 0x09: v = sleb(); break;
+                case 0x0a: v = fixed<int16_t>(); break;
+                case 0x0b: v = fixed<int32_t>(); break;
+                case 0x0c: v = fixed<int64_t>(); break;
+                default: return false;
+            }
+            out = base + v;
+            if( enc & 0x80 ) out = *(const uintptr_t *)out; // DW_EH_PE_indirect
+            return true;
+        }
+    };
+
+    // .eh_frame_hdr of the module holding pc, as the table stood at `generation`. lock-free
+    bool find_eh_frame_hdr( uintptr_t pc, uint64_t generation, const unsigned char *&hdr ) {
+        if( generation & 1 ) return false;
+        uintptr_t found = 0;
+        unsigned n = loaded_modules.count.load( std::memory_order_relaxed );
+        for( unsigned i = 0; i < n && i < HEAL_MAX_MODULES; ++i ) {
+            const module_table::range &r = loaded_modules.ranges[i];
+            if( pc >= r.lo.load( std::memory_order_relaxed ) && pc < r.hi.load( std::memory_order_relaxed ) ) {
+                found = r.eh_frame_hdr.load( std::memory_order_relaxed );
+                break;
+            }
+        }
+        std::atomic_thread_fence( std::memory_order_acquire );
+        if( loaded_modules.sequence.load( std::memory_order_relaxed ) != generation ) return false;
+        return hdr = (const unsigned char *)found, found != 0;
+    }
+
+    // keeps dlclose() from unmapping anything while a lookup reads .eh_frame. ok is false if one is already in flight
+    struct module_pin {
+        bool ok;
+        module_pin() { loaded_modules.readers.fetch_add( 1 ); ok = !loaded_modules.unloading.load(); }
+        ~module_pin() { loaded_modules.readers.fetch_sub( 1 ); }
+    };
+
+    // locate the FDE covering pc and run its CFA program up to pc. no allocations, no locks. callers hold a module_pin
+    bool compute_cfi_row( uintptr_t pc, uint64_t generation, cfi_row &row ) {
+        const unsigned char *eh_frame_hdr;
+        if( !find_eh_frame_hdr( pc, generation, eh_frame_hdr ) || eh_frame_hdr[0] != 1 ) return false;
+
+        // .eh_frame_hdr: binary search table of (initial location, fde) pairs
+        eh_reader hdr = { eh_frame_hdr + 4, (uintptr_t)eh_frame_hdr };
+        uintptr_t eh_frame, count;
+        if( !hdr.pointer( eh_frame_hdr[1], eh_frame ) || !hdr.pointer( eh_frame_hdr[2], count ) ) return false;
+        if( eh_frame_hdr[3] != 0x3b || !count ) return false; // DW_EH_PE_datarel | DW_EH_PE_sdata4
+        const int32_t *table = (const int32_t *)hdr.at;
+        size_t lo = 0, hi = count;
+        while( hi - lo > 1 ) {
+            size_t mid = ( lo + hi ) / 2;
+            if( (uintptr_t)eh_frame_hdr + table[ mid * 2 ] <= pc ) lo = mid; else hi = mid;
+        }
+        if( (uintptr_t)eh_frame_hdr + table[ lo * 2 ] > pc ) return false;
+        const unsigned char *fde = eh_frame_hdr + table[ lo * 2 + 1 ];
+
+        // FDE & CIE headers
+        eh_reader rd = { fde, 0 };
+        uint32_t fde_length = rd.fixed<uint32_t>();
+        if( fde_length == 0 || fde_length == 0xffffffff ) return false;
+        const unsigned char *fde_end = rd.at + fde_length;
+        const unsigned char *cie = rd.at - rd.fixed<uint32_t>();
+
+        eh_reader crd = { cie, 0 };
+        uint32_t cie_length = crd.fixed<uint32_t>();
+        if( cie_length == 0 || cie_length == 0xffffffff ) return false;
+        const unsigned char *cie_end = crd.at + cie_length;
+        if( crd.fixed<uint32_t>() != 0 ) return false;
+        uint8_t version = crd.fixed<uint8_t>();
+        const char *aug = (const char *)crd.at;
+        crd.at += strlen( aug ) + 1;
+        if( aug[0] == 'e' && aug[1] == 'h' ) crd.at += sizeof(void *);
+        uint64_t code_align = crd.uleb();
+        int64_t data_align = crd.sleb();
+        uint64_t ra_reg = version == 1 ? crd.fixed<uint8_t>() : crd.uleb();
+        uint8_t fde_enc = 0;
+        if( aug[0] == 'z' ) {
+            uint64_t aug_length = crd.uleb();
+            const unsigned char *aug_end = crd.at + aug_length;
+            for( const char *a = aug + 1; *a; ++a ) {
+                uintptr_t ignored;
+                /**/ if( *a == 'R' ) fde_enc = crd.fixed<uint8_t>();
+                else if( *a == 'L' ) crd.fixed<uint8_t>();
+                else if( *a == 'P' ) { if( !crd.pointer( crd.fixed<uint8_t>(), ignored ) ) return false; }
+                else if( *a != 'S' && *a != 'B' ) break;
+            }
+            crd.at = aug_end;
+        }
+        if( ra_reg != 16 ) return false;
+
+        uintptr_t pc_begin, pc_range;
+        if( !rd.pointer( fde_enc, pc_begin ) || !rd.pointer( fde_enc & 0x0f, pc_range ) ) return false;
+        if( pc < pc_begin || pc >= pc_begin + pc_range ) return false;
+        if( aug[0] == 'z' ) rd.at += rd.uleb();
+
+        // CFA programs. we only track what we need on x86_64: cfa rule, rbp (6) and rip (16)
+        enum { rbp = 6, rsp = 7, rip = 16, max_states = 8 };
+        struct state {
+            int64_t cfa_reg, cfa_offset, fp_offset, ra_offset;
+            bool fp_saved, ra_undefined, unsupported;
+        } initial = { rsp, 8, 0, -8, false, false, false }, st, stack[ max_states ];
+        unsigned depth = 0;
+
+        for( int pass = 0; pass < 2; ++pass ) {
+            eh_reader prog = pass == 0 ? crd : rd;
+            const unsigned char *end = pass == 0 ? cie_end : fde_end;
+            uintptr_t loc = pc_begin;
+            st = initial;
+            while( prog.at < end ) {
+                uint8_t op = prog.fixed<uint8_t>(), low = op & 0x3f;
+                uint64_t reg = 0; int64_t off = 0;
+                uintptr_t advance = 0;
+                switch( op & 0xc0 ) {
+                    case 0x40: advance = low * code_align; break;                         // DW_CFA_advance_loc
+                    case 0x80: reg = low, off = int64_t( prog.uleb() ) * data_align; goto offset; // DW_CFA_offset
+                    case 0xc0: reg = low; goto restore;                                   // DW_CFA_restore
+                }
+                switch( op ) {
+                    case 0x00: break;
+                    case 0x01: { uintptr_t to; if( !prog.pointer( fde_enc, to ) ) return false; advance = to > loc ? to - loc : 0; break; }
+                    case 0x02: advance = prog.fixed<uint8_t>() * code_align; break;
+                    case 0x03: advance = prog.fixed<uint16_t>() * code_align; break;
+                    case 0x04: advance = prog.fixed<uint32_t>() * code_align; break;
+                    case 0x05: reg = prog.uleb(), off = int64_t( prog.uleb() ) * data_align; goto offset;
+                    case 0x11: reg = prog.uleb(), off = prog.sleb() * data_align; goto offset;
+                    case 0x06: reg = prog.uleb(); goto restore;
+                    case 0x07: reg = prog.uleb(); if( reg == rip ) st.ra_undefined = true; if( reg == rbp ) st.fp_saved = false; break;
+                    case 0x08: reg = prog.uleb(); if( reg == rbp ) st.fp_saved = false; break;
+                    case 0x09: reg = prog.uleb(); prog.uleb(); if( reg == rbp || reg == rip ) st.unsupported = true; break;
+                    case 0x0a: if( depth == max_states ) return false; stack[ depth++ ] = st; break;
+                    case 0x0b: if( !depth ) return false; { bool u = st.unsupported; st = stack[ --depth ]; st.unsupported |= u; } break;
+                    case 0x0c: st.cfa_reg = prog.uleb(), st.cfa_offset = prog.uleb(); break;
+                    case 0x12: st.cfa_reg = prog.uleb(), st.cfa_offset = prog.sleb() * data_align; break;
+                    case 0x0d: st.cfa_reg = prog.uleb(); break;
+                    case 0x0e: st.cfa_offset = prog.uleb(); break;
+                    case 0x13: st.cfa_offset = prog.sleb() * data_align; break;
+                    case 0x0f: prog.at += prog.uleb(); st.unsupported = true; st.cfa_reg = -1; break;
+                    case 0x10: case 0x16: reg = prog.uleb(); prog.at += prog.uleb(); if( reg == rbp || reg == rip ) st.unsupported = true; break;
+                    case 0x14: case 0x15: reg = prog.uleb(); if( op == 0x14 ) prog.uleb(); else prog.sleb(); if( reg == rbp || reg == rip ) st.unsupported = true; break;
+                    case 0x2e: prog.uleb(); break;                                        // DW_CFA_GNU_args_size
+                    case 0x2f: reg = prog.uleb(), off = -int64_t( prog.uleb() ) * data_align; goto offset;
+                    default:
+                        if( ( op & 0xc0 ) == 0 ) return false;
+                }
+                if( advance ) {
+                    if( pass == 1 && loc + advance > pc ) break;
+                    loc += advance;
+                }
+                continue;
+                offset:
+                    if( reg == rbp ) st.fp_saved = true, st.fp_offset = off;
+                    if( reg == rip ) st.ra_offset = off;
+                    continue;
+                restore:
+                    if( reg == rbp ) st.fp_saved = initial.fp_saved, st.fp_offset = initial.fp_offset;
+                    if( reg == rip ) st.ra_offset = initial.ra_offset, st.ra_undefined = initial.ra_undefined;
+                    continue;
+            }
+            if( pass == 0 ) initial = st;
+        }
+
+        if( st.unsupported || ( st.cfa_reg != rsp && st.cfa_reg != rbp ) ) return false;
+        if( st.cfa_offset != int32_t( st.cfa_offset ) || st.fp_offset != int16_t( st.fp_offset ) || st.ra_offset != int8_t( st.ra_offset ) ) return false;
+        row.cfa_offset = int32_t( st.cfa_offset );
+        row.fp_offset = int16_t( st.fp_offset );
+        row.ra_offset = int16_t( st.ra_offset );
+        row.flags = cfi_row::valid | ( st.cfa_reg == rbp ? cfi_row::cfa_is_fp : 0 ) | ( st.fp_saved ? cfi_row::fp_saved : 0 ) | ( st.ra_undefined ? cfi_row::outermost : 0 );
+        return true;
+    }
+
+    // `relocate` is added to every saved frame pointer, for stacks unwound from a copy
+    unsigned unwind_eh( unwind_regs regs, const stack_bounds &bounds, void **out, unsigned capacity, unsigned skip, bool first_is_return_address, intptr_t relocate = 0 ) {
+        unsigned depth = 0;
+        for( bool ret = first_is_return_address; depth < capacity; ret = true ) {
+            // return addresses point past the call, which might be the last instruction of the function
+            uintptr_t lookup = ret ? regs.pc - 1 : regs.pc;
+            uint64_t packed, generation = module_generation();
+            cfi_row row;
+            if( cfi_rows.find( cfi_cache::key( lookup, generation ), packed ) ) row = cfi_row::unpack( packed );
+            else {
+                module_pin pin;
+                if( !pin.ok || !compute_cfi_row( lookup, generation, row ) ) row.flags = 0, row.cfa_offset = row.fp_offset = row.ra_offset = 0;
+                // a row computed while the table was changing may be stale already: do not keep it
+                if( pin.ok && !( generation & 1 ) && module_generation() == generation ) cfi_rows.insert( cfi_cache::key( lookup, generation ), row.pack() );
+            }
+            if( !( row.flags & cfi_row::valid ) || ( row.flags & cfi_row::outermost ) ) break;
+
+            uintptr_t cfa = ( row.flags & cfi_row::cfa_is_fp ? regs.fp : regs.sp ) + row.cfa_offset;
+            if( !readable( cfa + row.ra_offset, regs.sp, bounds ) ) break;
+            uintptr_t ra = *(const uintptr_t *)( cfa + row.ra_offset );
+            if( row.flags & cfi_row::fp_saved ) {
+                if( !readable( cfa + row.fp_offset, regs.sp, bounds ) ) break;
+                regs.fp = *(const uintptr_t *)( cfa + row.fp_offset ) + relocate;
+            }
+            if( !ra || cfa <= regs.sp ) break;
+            regs.pc = ra, regs.sp = cfa;
+            if( skip ) --skip; else out[ depth++ ] = (void *)ra;
+        }
+        return depth;
+    }
+
+#endif
+
+    std::atomic<int> current_unwinder( backtrace_unwinder );
+
+    // unwind an interrupted context, as received by a SA_SIGINFO signal handler.
+    // async-signal-safe: no locks, no allocations.
+    unsigned capture_context( const void *context, void **out, unsigned capacity ) {
+        const ucontext_t *uc = (const ucontext_t *)context;
+        unwind_regs regs;
+        #if defined(__x86_64__)
+        regs.pc = uc->uc_mcontext.gregs[ REG_RIP ];
+        regs.sp = uc->uc_mcontext.gregs[ REG_RSP ];
+        regs.fp = uc->uc_mcontext.gregs[ REG_RBP ];
+        #else
+        regs.pc = uc->uc_mcontext.pc;
+        regs.sp = uc->uc_mcontext.sp;
+        regs.fp = uc->uc_mcontext.regs[29];
+        #endif
+        if( !capacity || !regs.pc ) return 0;
+        out[0] = (void *)regs.pc;
+        const stack_bounds &bounds = thread_stack; // only if already known; never computed here
+        #if defined(__x86_64__)
+        if( current_unwinder.load( std::memory_order_relaxed ) != framepointer_unwinder )
+            return 1 + unwind_eh( regs, bounds, out + 1, capacity - 1, 0, false );
+        #endif
+        return 1 + unwind_fp( regs, bounds, out + 1, capacity - 1, 0 );
+    }
+}
+
+#endif
+
+bool set_unwinder( unwinder engine ) {
+    $unwinder(
+        #if !defined(__x86_64__)
+        if( engine == ehframe_unwinder ) return false;
+        #endif
+        current_unwinder = engine;
+        return true;
+    )
+    return engine == backtrace_unwinder;
+}
+
+// CALLSTACK
+
+namespace {
+
+    // process-wide address to symbol cache, shared by all unwind() calls.
+    // sharded to keep contention low; each shard is bounded and evicts arbitrary entries when full.
+    // the whole cache is flushed whenever a library gets dlopen'ed or dlclose'd. every lookup compares the module
+    // generation, a single load; misses also sync it with the loader first, for loads the dlopen() wrapper missed.
+
+    #ifndef HEAL_SYMBOL_CACHE_SIZE
+    #define HEAL_SYMBOL_CACHE_SIZE 16384
+    #endif
+
+    struct symbol_cache {
+        enum { num_shards = 16, shard_capacity = HEAL_SYMBOL_CACHE_SIZE / num_shards + 1 };
+
+        struct shard {
+            std::mutex mutex;
+            std::unordered_map< const void *, std::string > map;
+        } shards[ num_shards ];
+
+        std::atomic<uint64_t> hits, misses, flushes, generation;
+
+        symbol_cache() : hits(0), misses(0), flushes(0), generation(0)
+        {}
+
+        shard &at( const void *addr ) {
+            uintptr_t h = (uintptr_t)addr;
+            h ^= h >> 17, h *= 0x9E3779B1u, h ^= h >> 13;
+            return shards[ h % num_shards ];
+        }
+
+        bool find( const void *addr, std::string &out ) {
+            shard &s = at( addr );
+            std::lock_guard<std::mutex> lock( s.mutex );
+            std::unordered_map< const void *, std::string >::const_iterator it = s.map.find( addr );
+            if( it == s.map.end() ) return misses++, false;
+            return out = it->second, hits++, true;
+        }
+
+        void insert( const void *addr, const std::string &symbol ) {
+            shard &s = at( addr );
+            std::lock_guard<std::mutex> lock( s.mutex );
+            if( s.map.size() >= shard_capacity ) s.map.erase( s.map.begin() );
+            s.map[ addr ] = symbol;
+        }
+
+        size_t size() {
+            size_t n = 0;
+            for( unsigned i = 0; i < num_shards; ++i ) {
+                std::lock_guard<std::mutex> lock( shards[i].mutex );
+                n += shards[i].map.size();
+            }
+            return n;
+        }
+
+        void clear() {
+            for( unsigned i = 0; i < num_shards; ++i ) {
+                std::lock_guard<std::mutex> lock( shards[i].mutex );
+                shards[i].map.clear();
+            }
+            flushes++;
+        }
+
+        // flush everything if the module generation moved since last call. true if flushed
+        bool validate( uint64_t current ) {
+            if( generation.load( std::memory_order_relaxed ) == current || generation.exchange( current ) == current )
+                return false;
+            clear();
+            $linux( get_symbolizer().invalidate(); )
+            return true;
+        }
+    };
+
+    symbol_cache &get_symbol_cache() {
+        static symbol_cache *cache = new symbol_cache; // leaked on purpose; may be used from atexit/crash code
+        return *cache;
+    }
+}
+
+symbol_cache_stats get_symbol_cache_stats() {
+    symbol_cache &cache = get_symbol_cache();
+    symbol_cache_stats stats;
+    stats.hits = cache.hits;
+    stats.misses = cache.misses;
+    stats.flushes = cache.flushes;
+    stats.entries = cache.size();
+    return stats;
+}
+
+void clear_symbol_cache() {
+    get_symbol_cache().clear();
+}
+
+bool set_symbolizer( const std::string &backends ) {
+    $linux(
+        if( get_symbolizer().select( backends ) )
+            return clear_symbol_cache(), true;
+    )
+    return false;
+}
+
+        unsigned capture( void **out_frames, unsigned capacity, unsigned frames_to_skip ) {
+
+            if( !out_frames || !capacity || frames_to_skip > HEAL_MAX_TRACES )
+                return 0;
+
+            $windows({
+                // RtlCaptureStackBackTrace is only available on Windows XP or newer versions of Windows
+                typedef WORD(NTAPI FuncRtlCaptureStackBackTrace)(DWORD, DWORD, PVOID *, PDWORD);
+
+                static struct raii
+                {
+                    raii() : module(0), ptrRtlCaptureStackBackTrace(0)
+                    {
+                        module = LoadLibraryA("kernel32.dll");
+                        if( !module )
+                            fail( "<heal/heal.cpp> says: error! cant load kernel32.dll" );
+
+                        ptrRtlCaptureStackBackTrace = (FuncRtlCaptureStackBackTrace *)GetProcAddress(module, "RtlCaptureStackBackTrace");
+                        if( !ptrRtlCaptureStackBackTrace )
+                            fail( "<heal/heal.cpp> says: error! cant find RtlCaptureStackBackTrace() process address" );
+                    }
+                    ~raii() { if(module) FreeLibrary(module); }
+
+                    HMODULE module;
+                    FuncRtlCaptureStackBackTrace *ptrRtlCaptureStackBackTrace;
+                } module;
+
+                if( module.ptrRtlCaptureStackBackTrace )
+                    return module.ptrRtlCaptureStackBackTrace(frames_to_skip+1, capacity, out_frames, (DWORD *) 0);
+
+                return 0;
+            })
+            $unwinder({
+                int engine = current_unwinder.load( std::memory_order_relaxed );
+                if( engine != backtrace_unwinder ) {
+                    unwind_regs regs;
+                    #if defined(__x86_64__)
+                    __asm__ __volatile__( "lea 0(%%rip), %0\n\tmov %%rsp, %1\n\tmov %%rbp, %2" : "=r"(regs.pc), "=r"(regs.sp), "=r"(regs.fp) );
+                    if( engine == ehframe_unwinder )
+                        return unwind_eh( regs, current_stack_bounds(), out_frames, capacity, frames_to_skip, false );
+                    #else
+                    regs.sp = (uintptr_t)&regs, regs.pc = 0;
+                    #endif
+                    regs.fp = (uintptr_t)__builtin_frame_address(0);
+                    return unwind_fp( regs, current_stack_bounds(), out_frames, capacity, frames_to_skip );
+                }
+            })
+            $gnuc({
+                // skip ourselves too. capture into a local buffer when the skipped frames fit in there,
+                // else straight into the output at the expense of a few of the deepest frames
+                enum { local_frames = HEAL_MAX_TRACES + 32 };
+                void *local[ local_frames ];
+                unsigned skip = frames_to_skip + 1, depth;
+
+                if( capacity + skip <= local_frames ) {
+                    depth = unsigned( backtrace( local, int( capacity + skip ) ) );
+                    depth = depth > skip ? depth - skip : 0;
+                    std::memcpy( out_frames, local + skip, depth * sizeof(void *) );
+                } else {
+                    depth = unsigned( backtrace( out_frames, int( capacity ) ) );
+                    depth = depth > skip ? depth - skip : 0;
+                    std::memmove( out_frames, out_frames + skip, depth * sizeof(void *) );
+                }
+
+                return depth;
+            })
+
+            return 0;
+        }
+
+        std::vector<std::string> unwind( void * const *all_frames, size_t all_num_frames, unsigned from, unsigned to )
+        {
+            if( to == ~0u )
+                to = unsigned( all_num_frames );
+
+            if( from > to || from > all_num_frames || to > all_num_frames )
+                return std::vector<std::string>();
+
+            const size_t num_frames = to - from;
+            std::vector<std::string> backtraces( num_frames );
+            if( !num_frames )
+                return backtraces;
+
+            void * const * frames = &all_frames[ from ];
+            const std::string invalid = "????";
+
+            // serve whatever we can from the symbol cache. only misses get resolved below
+            symbol_cache &cache = get_symbol_cache();
+            std::vector<bool> cached( num_frames, false );
+            size_t resolved = 0;
+            $linux( cache.validate( module_generation() ); )
+            for( unsigned i = 0; i < num_frames; i++ )
+                resolved += ( cached[i] = cache.find( frames[i], backtraces[i] ) );
+            if( resolved == num_frames )
+                return backtraces;
+            bool flushed = false;
+            $linux( flushed = cache.validate( sync_modules() ); )
+            if( flushed ) { // a library came or went unnoticed: what we just got may be stale
+                cached.assign( num_frames, false );
+                backtraces.assign( num_frames, std::string() );
+            }
+
+            $windows({
+                SymSetOptions(SYMOPT_UNDNAME);
+
+                $no(
+                    // polite version. this is how things should be done.
+                    HANDLE process = GetCurrentProcess();
+                    if( SymInitialize( process, NULL, TRUE ) )
+                )
+                $yes(
+                    // this is what we have to do because other memory managers are not polite enough. fuck them off
+                    static HANDLE process = GetCurrentProcess();
+                    static int init = SymInitialize( process, NULL, TRUE );
+                    if( !init )
+                        fail( "<heal/heal.cpp> says: cannot initialize Dbghelp.lib" );
+                )
+                {
+                    enum { MAXSYMBOLNAME = 512 - sizeof(IMAGEHLP_SYMBOL64) };
+                    char symbol64_buf     [ 512 ];
+                    char symbol64_bufblank[ 512 ] = {0};
+                    IMAGEHLP_SYMBOL64 *symbol64       = reinterpret_cast<IMAGEHLP_SYMBOL64*>(symbol64_buf);
+                    IMAGEHLP_SYMBOL64 *symbol64_blank = reinterpret_cast<IMAGEHLP_SYMBOL64*>(symbol64_bufblank);
+                    symbol64_blank->SizeOfStruct = sizeof(IMAGEHLP_SYMBOL64);
+                    symbol64_blank->MaxNameLength = (MAXSYMBOLNAME-1) / 2; //wchar?
+
+                    IMAGEHLP_LINE64 line64, line64_blank = {0};
+                    line64_blank.SizeOfStruct = sizeof(IMAGEHLP_LINE64);
+
+                    for( unsigned i = 0; i < num_frames; i++ ) {
+                        if( cached[i] ) continue;
+                        *symbol64 = *symbol64_blank;
+                        DWORD64 displacement64 = 0;
+
+                        if( SymGetSymFromAddr64( process, (DWORD64) frames[i], &displacement64, symbol64 ) ) {
+                            line64 = line64_blank;
+                            DWORD displacement = 0;
+                            if( SymGetLineFromAddr64( process, (DWORD64) frames[i], &displacement, &line64 ) ) {
+                                backtraces[i] = heal::sfstring( "\1 (\2:\3)", symbol64->Name, line64.FileName, line64.LineNumber );
+                            } else {
+                                backtraces[i] = symbol64->Name;
+                            }
+                        } else  backtraces[i] = invalid;
+                        cache.insert( frames[i], backtraces[i] );
+                    }
+
+                    $no(
+                        // fuck the others. cleanup commented.
+                        SymCleanup(process);
+                    )
+                }
+                DWORD error = GetLastError();
+
+                return backtraces;
+            })
+            $gnuc({
+                char **strings = 0;
+
+                // Decode the frames. backtrace_symbols() is only requested if every symbolizer backend fails
+                $linux({
+                    // in-process, one batch for all uncached frames
+                    std::vector<void *> pending;
+                    std::vector<unsigned> index;
+                    for( unsigned i = 0; i < num_frames; i++ ) {
+                        if( !cached[i] ) pending.push_back( frames[i] ), index.push_back( i );
+                    }
+                    std::vector<std::string> symbols( pending.size() );
+                    get_symbolizer().resolve( &pending[0], pending.size(), &symbols[0] );
+                    for( size_t i = 0; i < index.size(); i++ ) {
+                        backtraces[ index[i] ].swap( symbols[i] );
+                    }
+                })
+                // whatever is left gets described, not symbolized again: module+offset, else backtrace_symbols()
+                for( unsigned i = 0; i < num_frames; i++ ) {
+                    if( cached[i] ) continue;
+                    $linux(
+                        if( backtraces[i].empty() ) backtraces[i] = get_symbolizer().locate( frames[i] );
+                    )
+                    if( backtraces[i].empty() ) {
+                        if( !strings ) strings = backtrace_symbols(frames, num_frames);
+                        backtraces[i] = ( strings && strings[i] ? std::string( strings[i] ) : invalid );
+                    }
+                    cache.insert( frames[i], backtraces[i] );
+                }
+                if( strings ) free( strings );
+
+                return backtraces;
+            })
+
+            return backtraces;
+        }
+
+        std::vector<std::string> format_stack( void * const *frames, size_t num_frames, const char *format12, size_t skip_begin ) {
+            std::vector<std::string> stacktrace = unwind( frames, num_frames, unsigned( skip_begin ) );
+
+            for( size_t i = 0, end = stacktrace.size(); i < end; i++ )
+                stacktrace[i] = heal::sfstring( format12, i + 1, stacktrace[i] );
+
+            return stacktrace;
+        }
+
+std::vector<std::string> stacktrace( const char *format12, size_t skip_initial ) {
+    return callstack(true).str( format12, skip_initial );
+}
+
+std::string stackstring( const char *format12, size_t skip_initial ) {
+    std::string out;
+    std::vector<std::string> stack = stacktrace( format12, skip_initial );
+    for( std::vector<std::string>::const_iterator it = stack.begin(), end = stack.end(); it != end; ++it ) {
+        out += *it;
+    }
+    return out;
+}
+
+// STACK DEPOT
+// Interns frame arrays: every distinct stack is stored once in an append-only arena and is
+// referred to by a 32-bit id. Memory grows with distinct stacks, not with captures.
+// Lock-free: arena space is reserved with fetch_add, chains are published with CAS, and readers
+// never block. Nothing is ever freed.
+
+namespace {
+
+    struct stack_depot {
+        enum { chunk_bits = 20, chunk_size = 1 << chunk_bits, max_chunks = 1 << 15, num_buckets = 1 << 16 };
+
+        struct node {
+            uint32_t next, hash, size, reserved;
+            void *frames[1];
+        };
+
+        std::atomic<char *> chunks[ max_chunks ];
+        std::atomic<uint32_t> buckets[ num_buckets ];
+        std::atomic<uint64_t> tail, stacks, bytes;
+
+        static uint32_t hash( void * const *frames, size_t num_frames ) {
+            uint64_t h = 0xcbf29ce484222325ull ^ num_frames;
+            for( size_t i = 0; i < num_frames; ++i ) {
+                h ^= (uintptr_t)frames[i];
+                h *= 0x100000001b3ull;
+                h ^= h >> 29;
+            }
+            return uint32_t( h ^ ( h >> 32 ) );
+        }
+
+        // raw pages; we may be called from within allocation hooks
+        static char *map_chunk() {
+            $windows( return (char *)VirtualAlloc( 0, chunk_size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE ); )
+            $welse(
+                void *ptr = mmap( 0, chunk_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+                return ptr == MAP_FAILED ? (char *)0 : (char *)ptr;
+            )
+        }
+        static void unmap_chunk( char *ptr ) {
+            $windows( VirtualFree( ptr, 0, MEM_RELEASE ); )
+            $welse( munmap( ptr, chunk_size ); )
+        }
+
+        node *at( uint32_t id ) const {
+            uint64_t offset = uint64_t( id - 1 ) << 3;
+            char *chunk = chunks[ offset >> chunk_bits ].load( std::memory_order_acquire );
+            return (node *)( chunk + ( offset & ( chunk_size - 1 ) ) );
+        }
+
+        node *allocate( size_t num_frames, uint32_t &id ) {
+            uint64_t size = ( offsetof( node, frames ) + num_frames * sizeof(void *) + 7 ) & ~7ull;
+            for(;;) {
+                uint64_t offset = tail.fetch_add( size, std::memory_order_relaxed );
+                uint64_t chunk = offset >> chunk_bits;
+                if( chunk >= max_chunks ) return 0;
+                if( ( offset & ( chunk_size - 1 ) ) + size > chunk_size ) continue; // would straddle two chunks
+                char *base = chunks[ chunk ].load( std::memory_order_acquire );
+                if( !base ) {
+                    char *fresh = map_chunk(), *expected = 0;
+                    if( !fresh ) return 0;
+                    if( chunks[ chunk ].compare_exchange_strong( expected, fresh, std::memory_order_acq_rel ) ) base = fresh;
+                    else unmap_chunk( fresh ), base = expected;
+                }
+                id = uint32_t( ( offset >> 3 ) + 1 );
+                bytes.fetch_add( size, std::memory_order_relaxed );
+                return (node *)( base + ( offset & ( chunk_size - 1 ) ) );
+            }
+        }
+
+        uint32_t find( uint32_t from, uint32_t until, uint32_t h, void * const *frames, size_t num_frames ) const {
+            for( uint32_t id = from; id && id != until; ) {
+                const node *n = at( id );
+                if( n->hash == h && n->size == num_frames && !std::memcmp( n->frames, frames, num_frames * sizeof(void *) ) )
+                    return id;
+                id = n->next;
+            }
+            return 0;
+        }
+
+        uint32_t intern( void * const *frames, size_t num_frames ) {
+            if( !frames || !num_frames ) return 0;
+            uint32_t h = hash( frames, num_frames );
+            std::atomic<uint32_t> &bucket = buckets[ h % num_buckets ];
+            uint32_t head = bucket.load( std::memory_order_acquire );
+            uint32_t found = find( head, 0, h, frames, num_frames );
+            if( found ) return found;
+
+            uint32_t id;
+            node *n = allocate( num_frames, id );
+            if( !n ) return 0;
+            n->hash = h, n->size = uint32_t( num_frames ), n->reserved = 0;
+            std::memcpy( n->frames, frames, num_frames * sizeof(void *) );
+            for(;;) {
+                n->next = head;
+                uint32_t seen = head;
+                if( bucket.compare_exchange_weak( head, id, std::memory_order_release, std::memory_order_acquire ) ) break;
+                // somebody else got in first. was it the very same stack? then our node is just wasted arena
+                if( (found = find( head, seen, h, frames, num_frames )) != 0 ) return found;
+            }
+            stacks.fetch_add( 1, std::memory_order_relaxed );
+            return id;
+        }
+    };
+
+    stack_depot &get_stack_depot() {
+        static std::atomic<stack_depot *> instance( 0 );
+        stack_depot *depot = instance.load( std::memory_order_acquire );
+        if( !depot ) {
+            stack_depot *fresh = (stack_depot *)std::calloc( 1, sizeof(stack_depot) ); // zeroed atomics; leaked on purpose
+            if( instance.compare_exchange_strong( depot, fresh ) ) depot = fresh;
+            else std::free( fresh );
+        }
+        return *depot;
+    }
+}
+
+stackid intern( void * const *frames, size_t num_frames ) {
+    return stackid( get_stack_depot().intern( frames, num_frames ) );
+}
+
+size_t stackid::size() const {
+    return id ? get_stack_depot().at( id )->size : 0;
+}
+
+void * const *stackid::frames() const {
+    return id ? get_stack_depot().at( id )->frames : 0;
+}
+
+std::vector<std::string> stackid::unwind( unsigned from, unsigned to ) const {
+    return heal::unwind( frames(), size(), from, to );
+}
+
+std::vector<std::string> stackid::str( const char *format12, size_t skip_begin ) const {
+    return heal::format_stack( frames(), size(), format12, skip_begin );
+}
+
+std::string stackid::flat( const char *format12, size_t skip_begin ) const {
+    std::vector<std::string> vec = str( format12, skip_begin );
+    std::string out;
+    for( std::vector<std::string>::const_iterator it = vec.begin(), end = vec.end(); it != end; ++it ) {
+        out += *it;
+    }
+    return out;
+}
+
+stack_depot_stats get_stack_depot_stats() {
+    stack_depot &depot = get_stack_depot();
+    stack_depot_stats stats;
+    stats.stacks = depot.stacks.load();
+    stats.bytes = depot.bytes.load();
+    return stats;
+}
+
+// OFFLINE SYMBOLIZATION
+// Capture-time cost stays near zero: dump_stack() only prints raw return addresses, and module_snapshot()
+// describes the loaded objects (load bias, address range, build-id, path) once. heal-symbolize.cc (or
+// symbolize_dump() below) turns both back into the same text that callstack::str() produces.
+//
+// Dump format, one record per line:
+//   heal-modules 1
+//   m <bias> <lo> <hi> <build-id|-> <path>
+//   s <addr> <addr> ...
+
+std::string module_snapshot() {
+    std::string out = "heal-modules 1\n";
+    $linux({
+        static std::mutex mutex;
+        static std::string cached;
+        static uint64_t generation = ~0ull;
+        std::lock_guard<std::mutex> lock( mutex );
+        uint64_t current = sync_modules();
+        if( current != generation || cached.empty() ) {
+            std::vector< loaded_module > modules;
+            dl_iterate_phdr( &symbolizer::collect, &modules );
+            cached.clear();
+            for( size_t i = 0; i < modules.size(); ++i ) {
+                char buf[128];
+                sprintf( buf, "m %" PRIxPTR " %" PRIxPTR " %" PRIxPTR " ", modules[i].bias, modules[i].lo, modules[i].hi );
+                cached += buf + ( modules[i].build_id.empty() ? std::string("-") : modules[i].build_id ) + " " + modules[i].path + "\n";
+            }
+            generation = current;
+        }
+        out += cached;
+    })
+    return out;
+}
+
+std::string dump_stack( void * const *frames, size_t num_frames ) {
+    std::string out( 1, 's' );
+    char buf[32];
+    for( size_t i = 0; i < num_frames; ++i ) {
+        sprintf( buf, " %" PRIxPTR, (uintptr_t)frames[i] );
+        out += buf;
+    }
+    return out += '\n', out;
+}
+
+std::string symbolize( const std::string &binary, uint64_t offset ) {
+    $linux({
+        std::vector<uint64_t> offsets( 1, offset );
+        std::vector<std::string> out;
+        get_symbolizer().resolve( binary, offsets, out );
+        if( !out[0].empty() ) return out[0];
+    })
+    char buf[32];
+    sprintf( buf, "+0x%" PRIx64, offset );
+    return binary + buf;
+}
+
+std::string symbolize_dump( std::istream &is, const char *format12 ) {
+    struct module {
+        uint64_t bias, lo, hi;
+        std::string build_id, path;
+        bool checked;
+    };
+    std::vector< module > modules;
+    std::string out, line;
+    size_t stacks = 0;
+
+    while( std::getline( is, line ) ) {
+        std::stringstream ss( line );
+        std::string tag;
+        if( !(ss >> tag) ) continue;
+
+        if( tag == "m" ) {
+            module m;
+            if( ss >> std::hex >> m.bias >> m.lo >> m.hi >> m.build_id ) {
+                std::getline( ss >> std::ws, m.path );
+                m.checked = false;
+                modules.push_back( m );
+            }
+            continue;
+        }
+        if( tag != "s" ) continue;
+
+        // resolve every frame against the module table
+        std::vector<std::string> frames;
+        for( uint64_t addr; ss >> std::hex >> addr; ) {
+            size_t i = 0;
+            while( i < modules.size() && !( addr >= modules[i].lo && addr < modules[i].hi ) ) ++i;
+            if( i == modules.size() ) {
+                char buf[32];
+                sprintf( buf, "0x%" PRIx64, addr );
+                frames.push_back( buf );
+                continue;
+            }
+            module &m = modules[i];
+            $linux(
+                if( !m.checked && m.build_id != "-" ) {
+                    std::string found = get_symbolizer().build_id( m.path );
+                    if( found != m.build_id )
+                        out += "# warning: build-id mismatch for " + m.path + " (" + m.build_id + " expected, " + ( found.empty() ? "none" : found ) + " found)\n";
+                }
+            )
+            m.checked = true;
+            frames.push_back( symbolize( m.path, addr - m.bias ) );
+        }
+
+        if( stacks++ ) out += '\n';
+        for( size_t i = 0; i < frames.size(); ++i )
+            out += heal::sfstring( format12, i + 1, frames[i] );
+    }
+    return out;
+}
+
+// BINARY LOG
+// HEAL_LOG() callsites register their format once and get a 32-bit id. The hot path then writes one
+// record into a per-thread ring: { id, size, cycle counter, raw arguments }, 8-byte aligned, and strings
+// length-prefixed. It never formats or locks, and only calls into the OS to wake the writer up when its ring
+// passes half full. Otherwise the writer drains the rings every few ms into a file of tagged records, along
+// with the format table and clock sync points:
+//   "HEALBLOG" u32 version
+//   'F' u32 id, u32 line, u16 len + types, u16 len + file, u32 len + format
+//   'S' u64 cycles, u64 realtime ns
+//   'T' u32 tid                              following events belong to this thread
+//   'E' u32 id, u64 cycles, u32 len + args
+//   'D' u32 tid, u64 dropped                 records lost on a full ring
+// decode() sorts the events by cycle count and converts cycles to time from the first and last sync points.
+
+#ifndef HEAL_LOG_RING_SIZE
+#define HEAL_LOG_RING_SIZE (1024 * 1024)    // bytes per thread, power of two
+#endif
+
+std::atomic<bool> binlog::enabled( false );
+
+namespace {
+
+    struct log_format {
+        std::string fmt, file, types;
+        uint32_t line;
+    };
+
+    struct log_ring {
+        std::atomic<uint32_t> head, tail;   // byte counters; head: owner thread, tail: writer
+        std::atomic<uint64_t> dropped;      // since acquired
+        uint64_t dropped_written;           // writer only
+        std::atomic<bool> orphan;           // owner thread is gone
+        uint32_t tid;
+        uint64_t data[ HEAL_LOG_RING_SIZE / 8 ];
+    };
+
+    struct log_state {
+        std::mutex mutex;
+        std::vector< log_format > formats;
+        std::vector< log_ring * > rings, spare;
+        std::thread writer;
+        std::condition_variable wakeup;     // a ring passed half full
+        std::atomic<bool> stopping;
+        FILE *out;
+        size_t formats_written;
+        uint64_t dropped;                   // by rings recycled since start()
+
+        log_state() : stopping( false ), out( 0 ), formats_written( 0 ), dropped( 0 )
+        {}
+    };
+
+    log_state &get_log() {
+        static log_state *state = new log_state(); // leaked on purpose; threads may log until the very end
+        return *state;
+    }
+
+    uint32_t current_tid() {
+        $linux( return uint32_t( syscall( SYS_gettid ) ); )
+        return uint32_t( std::hash< std::thread::id >()( std::this_thread::get_id() ) );
+    }
+
+    // rings outlive their threads until drained, then get recycled
+    struct log_ring_owner {
+        log_ring *ring;
+        ~log_ring_owner() {
+            if( ring ) ring->orphan = true;
+        }
+    };
+    thread_local log_ring_owner log_owner = { 0 };
+
+    log_ring *acquire_log_ring() {
+        log_state &s = get_log();
+        std::lock_guard<std::mutex> lock( s.mutex );
+        log_ring *r;
+        if( !s.spare.empty() ) r = s.spare.back(), s.spare.pop_back();
+        else r = new log_ring();
+        r->head = 0, r->tail = 0, r->dropped = 0, r->dropped_written = 0, r->orphan = false;
+        r->tid = current_tid();
+        s.rings.push_back( r );
+        return r;
+    }
+
+    struct log_file {
+        FILE *fp;
+        void u8( uint8_t v ) { fwrite( &v, 1, 1, fp ); }
+        void u16( uint16_t v ) { fwrite( &v, 2, 1, fp ); }
+        void u32( uint32_t v ) { fwrite( &v, 4, 1, fp ); }
+        void u64( uint64_t v ) { fwrite( &v, 8, 1, fp ); }
+        void bytes( const void *p, size_t n ) { if( n ) fwrite( p, 1, n, fp ); }
+    };
+
+    void write_log_sync( log_file &f ) {
+        f.u8( 'S' );
+        f.u64( binlog::cycles() );
+        f.u64( uint64_t( std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::system_clock::now().time_since_epoch() ).count() ) );
+    }
+
+    // writer thread side. the mutex is only taken to pick up new formats and rings, and to recycle orphans:
+    // file output happens outside of it, so define() and acquire_log_ring() never wait on the disk
+    void drain_logs( log_state &s ) {
+        std::vector< log_format > formats;
+        std::vector< log_ring * > rings, orphans;
+        size_t first;
+        {
+            std::lock_guard<std::mutex> lock( s.mutex );
+            first = s.formats_written;
+            formats.assign( s.formats.begin() + first, s.formats.end() );
+            s.formats_written = s.formats.size();
+            rings = s.rings;
+        }
+        log_file f = { s.out };
+        for( size_t i = 0; i < formats.size(); ++i ) {
+            const log_format &lf = formats[i];
+            f.u8( 'F' ), f.u32( uint32_t( first + i + 1 ) ), f.u32( lf.line );
+            f.u16( uint16_t( lf.types.size() ) ), f.bytes( lf.types.data(), lf.types.size() );
+            f.u16( uint16_t( lf.file.size() ) ), f.bytes( lf.file.data(), lf.file.size() );
+            f.u32( uint32_t( lf.fmt.size() ) ), f.bytes( lf.fmt.data(), lf.fmt.size() );
+        }
+        write_log_sync( f );
+        for( size_t i = 0; i < rings.size(); ++i ) {
+            log_ring *r = rings[i];
+            bool orphan = r->orphan.load( std::memory_order_acquire ); // read before head: nothing comes after it
+            uint32_t tail = r->tail.load( std::memory_order_relaxed ), head = r->head.load( std::memory_order_acquire );
+            const unsigned char *data = (const unsigned char *)r->data;
+            if( tail != head ) f.u8( 'T' ), f.u32( r->tid );
+            while( tail != head ) {
+                uint32_t off = tail & ( HEAL_LOG_RING_SIZE - 1 ), id, size;
+                std::memcpy( &id, data + off, 4 );
+                if( !id ) { // padding up to the end of the ring
+                    tail += HEAL_LOG_RING_SIZE - off;
+                    continue;
+                }
+                std::memcpy( &size, data + off + 4, 4 );
+                f.u8( 'E' ), f.u32( id ), f.bytes( data + off + 8, 8 ), f.u32( size - 16 ), f.bytes( data + off + 16, size - 16 );
+                tail += size;
+            }
+            r->tail.store( tail, std::memory_order_release );
+            uint64_t dropped = r->dropped.load( std::memory_order_relaxed );
+            if( dropped != r->dropped_written ) f.u8( 'D' ), f.u32( r->tid ), f.u64( dropped - r->dropped_written ), r->dropped_written = dropped;
+            if( orphan ) orphans.push_back( r );
+        }
+        fflush( s.out );
+        if( orphans.empty() ) return;
+        std::lock_guard<std::mutex> lock( s.mutex );
+        for( size_t i = 0; i < orphans.size(); ++i ) {
+            s.rings.erase( std::find( s.rings.begin(), s.rings.end(), orphans[i] ) );
+            s.dropped += orphans[i]->dropped.load();
+            s.spare.push_back( orphans[i] );
+        }
+    }
+
+    struct log_reader {
+        std::istream &is;
+        template<typename T> T get() { T v = T(); is.read( (char *)&v, sizeof(T) ); return v; }
+        std::string str( size_t n ) { std::string v( n, '\0' ); if( n ) is.read( &v[0], n ); return v; }
+    };
+
+    void log_writer( log_state *s ) {
+        for( bool last = false; !last; ) {
+            last = s->stopping.load();
+            drain_logs( *s );
+            if( !last ) {
+                std::unique_lock<std::mutex> lock( s->mutex );
+                s->wakeup.wait_for( lock, std::chrono::milliseconds( 5 ) );
+            }
+        }
+    }
+}
+
+uint32_t binlog::define( const char *file, int line, const char *fmt, const fmtarg *args, size_t num_args ) {
+    static const char codes[] = "iudspp"; // by fmtarg::kind; cstr and str are both stored as strings
+    log_format lf;
+    lf.fmt = fmt ? fmt : "", lf.file = file ? file : "", lf.line = uint32_t( line );
+    for( size_t i = 0; i < num_args; ++i ) lf.types += args[i].type == fmtarg::str ? 's' : codes[ args[i].type ];
+    log_state &s = get_log();
+    std::lock_guard<std::mutex> lock( s.mutex );
+    s.formats.push_back( lf );
+    return uint32_t( s.formats.size() );
+}
+
+void binlog::record( uint32_t id, const fmtarg *args, size_t num_args ) {
+    uint64_t stamp = cycles();
+    log_ring *r = log_owner.ring;
+    if( $unlikely( !r ) ) r = log_owner.ring = acquire_log_ring();
+
+    uint32_t size = 16, lengths[ 16 ] = {};
+    for( size_t i = 0; i < num_args; ++i ) {
+        if( args[i].type == fmtarg::cstr || args[i].type == fmtarg::str ) {
+            size_t len = args[i].type == fmtarg::str ? args[i].string->size() : args[i].s ? std::strlen( args[i].s ) : 0;
+            if( i < 16 ) lengths[i] = uint32_t( len );
+            size += 4 + uint32_t( len );
+        }
+        else size += 8;
+    }
+    size = ( size + 7 ) & ~7u;
+    uint32_t head = r->head.load( std::memory_order_relaxed ), tail = r->tail.load( std::memory_order_acquire );
+    uint32_t off = head & ( HEAL_LOG_RING_SIZE - 1 ), pad = off + size > HEAL_LOG_RING_SIZE ? HEAL_LOG_RING_SIZE - off : 0;
+    if( num_args > 16 || size > HEAL_LOG_RING_SIZE / 4 || pad + size > HEAL_LOG_RING_SIZE - ( head - tail ) ) {
+        r->dropped.fetch_add( 1, std::memory_order_relaxed );
+        return;
+    }
+    unsigned char *data = (unsigned char *)r->data;
+    if( pad ) {
+        std::memset( data + off, 0, 4 );
+        off = 0;
+    }
+    unsigned char *p = data + off;
+    std::memcpy( p, &id, 4 ), std::memcpy( p + 4, &size, 4 ), std::memcpy( p + 8, &stamp, 8 );
+    p += 16;
+    for( size_t i = 0; i < num_args; ++i ) {
+        switch( args[i].type ) {
+            case fmtarg::cstr: std::memcpy( p, &lengths[i], 4 ), std::memcpy( p + 4, args[i].s, lengths[i] ), p += 4 + lengths[i]; break;
+            case fmtarg::str: std::memcpy( p, &lengths[i], 4 ), std::memcpy( p + 4, args[i].string->data(), lengths[i] ), p += 4 + lengths[i]; break;
+            case fmtarg::ptr: { uint64_t v = uint64_t( uintptr_t( args[i].p ) ); std::memcpy( p, &v, 8 ), p += 8; } break;
+            default: std::memcpy( p, &args[i].u, 8 ), p += 8; break;
+        }
+    }
+    r->head.store( head + pad + size, std::memory_order_release );
+    // wake the writer once per crossing of the half mark. a lost wakeup only costs the rest of its 5 ms nap
+    const uint32_t half = HEAL_LOG_RING_SIZE / 2, used = head + pad + size - tail;
+    if( $unlikely( used >= half && used - pad - size < half ) ) get_log().wakeup.notify_one();
+}
+
+bool binlog::start( const std::string &path ) {
+    log_state &s = get_log();
+    std::lock_guard<std::mutex> lock( s.mutex );
+    if( s.out ) return false;
+    if( !( s.out = fopen( path.c_str(), "wb" ) ) ) return false;
+    fwrite( "HEALBLOG", 1, 8, s.out );
+    uint32_t version = 1;
+    fwrite( &version, 4, 1, s.out );
+    s.formats_written = 0;
+    for( size_t i = 0; i < s.rings.size(); ++i ) { // stale records from a previous run
+        log_ring *r = s.rings[i];
+        r->tail = r->head.load(), r->dropped = 0, r->dropped_written = 0;
+    }
+    s.dropped = 0;
+    s.stopping = false;
+    s.writer = std::thread( log_writer, &s );
+    enabled = true;
+    return true;
+}
+
+uint64_t binlog::dropped() {
+    log_state &s = get_log();
+    std::lock_guard<std::mutex> lock( s.mutex );
+    uint64_t n = s.dropped;
+    for( size_t i = 0; i < s.rings.size(); ++i ) n += s.rings[i]->dropped.load( std::memory_order_relaxed );
+    return n;
+}
+
+void binlog::stop() {
+    log_state &s = get_log();
+    std::thread writer;
+    {
+        std::lock_guard<std::mutex> lock( s.mutex );
+        if( !s.out ) return;
+        enabled = false;
+        s.stopping = true;
+        writer.swap( s.writer );
+    }
+    writer.join(); // last drain happens after `enabled` went down
+    std::lock_guard<std::mutex> lock( s.mutex );
+    fclose( s.out );
+    s.out = 0;
+}
+
+std::string binlog::decode( std::istream &is ) {
+    log_reader in = { is };
+    struct event {
+        uint64_t stamp;
+        uint32_t tid, id;
+        std::string args;
+        bool operator<( const event &other ) const { return stamp < other.stamp; }
+    };
+
+    if( in.str( 8 ) != "HEALBLOG" || in.get<uint32_t>() != 1 ) return "not a heal binary log\n";
+    std::map< uint32_t, log_format > formats;
+    std::vector< event > events;
+    std::map< uint32_t, uint64_t > dropped;
+    uint64_t first_stamp = 0, first_ns = 0, last_stamp = 0, last_ns = 0;
+    bool synced = false;
+    uint32_t tid = 0;
+    for( int tag; ( tag = is.get() ) != EOF && is; ) {
+        if( tag == 'F' ) {
+            uint32_t id = in.get<uint32_t>();
+            log_format &lf = formats[ id ];
+            lf.line = in.get<uint32_t>();
+            lf.types = in.str( in.get<uint16_t>() );
+            lf.file = in.str( in.get<uint16_t>() );
+            lf.fmt = in.str( in.get<uint32_t>() );
+        }
+        else if( tag == 'S' ) {
+            last_stamp = in.get<uint64_t>(), last_ns = in.get<uint64_t>();
+            if( !synced ) first_stamp = last_stamp, first_ns = last_ns, synced = true;
+        }
+        else if( tag == 'T' ) tid = in.get<uint32_t>();
+        else if( tag == 'E' ) {
+            event e;
+            e.tid = tid, e.id = in.get<uint32_t>(), e.stamp = in.get<uint64_t>();
+            e.args = in.str( in.get<uint32_t>() );
+            events.push_back( e );
+        }
+        else if( tag == 'D' ) {
+            uint32_t who = in.get<uint32_t>();
+            dropped[ who ] += in.get<uint64_t>();
+        }
+        else return "corrupted heal binary log\n";
+    }
+    std::stable_sort( events.begin(), events.end() );
+
+    double cycles_per_ns = last_ns > first_ns && last_stamp > first_stamp ? double( last_stamp - first_stamp ) / double( last_ns - first_ns ) : 1.0;
+    std::string out;
+    for( size_t e = 0; e < events.size(); ++e ) {
+        std::map< uint32_t, log_format >::const_iterator found = formats.find( events[e].id );
+        if( found == formats.end() ) continue;
+        const log_format &lf = found->second;
+
+        // rebuild the arguments, then format as HEAL_WARNF() would
+        std::vector< fmtarg > args;
+        std::vector< std::string > strings( lf.types.size() );
+        const char *p = events[e].args.data(), *end = p + events[e].args.size();
+        for( size_t i = 0; i < lf.types.size() && p < end; ++i ) {
+            uint64_t raw = 0;
+            if( lf.types[i] == 's' ) {
+                uint32_t len;
+                std::memcpy( &len, p, 4 );
+                strings[i].assign( p + 4, (std::min)( size_t( len ), size_t( end - p - 4 ) ) );
+                args.push_back( fmtarg( strings[i] ) );
+                p += 4 + len;
+                continue;
+            }
+            std::memcpy( &raw, p, 8 );
+            p += 8;
+            fmtarg a( (unsigned long long)raw );
+            if( lf.types[i] == 'i' ) a.type = fmtarg::i64;
+            if( lf.types[i] == 'd' ) a.type = fmtarg::f64;
+            if( lf.types[i] == 'p' ) a.type = fmtarg::ptr, a.p = (const void *)uintptr_t( raw );
+            args.push_back( a );
+        }
+        uint64_t ns = first_ns + uint64_t( int64_t( ( double( events[e].stamp ) - double( first_stamp ) ) / cycles_per_ns ) );
+        char stamp[64];
+        sprintf( stamp, "%llu.%09llu ", (unsigned long long)( ns / 1000000000 ), (unsigned long long)( ns % 1000000000 ) );
+        out += stamp + heal::sfstring( "\1 \2:\3: ", events[e].tid, lf.file, lf.line ) + format_list( lf.fmt.data(), lf.fmt.size(), args.empty() ? 0 : &args[0], args.size() ) + "\n";
+    }
+    for( std::map< uint32_t, uint64_t >::const_iterator it = dropped.begin(); it != dropped.end(); ++it )
+        out += heal::sfstring( "# thread \1 dropped \2 records\n", it->first, it->second );
+    return out;
+}
+
+// FLIGHT RECORDER
+// Everything lives in one MAP_SHARED file mapping, so whatever was written survives the process: a SIGKILL
+// or the OOM killer stops the writers, and the kernel still owns the dirty pages. Layout, all fixed at open():
+//   header        magic, pid, clock sync, event names, exe path (4 KiB)
+//   modules       module_snapshot() text, for symbolizing stacks later
+//   stacks        append-only { u32 id, u32 count, u64 frames[count] } records, one per distinct stack
+//   slots         one per thread: { state, tid, head, name } + a ring of 64-byte events
+// Each thread claims a slot on its first event and is the only writer of its ring afterwards. An event is
+// valid when its sequence number matches its position, so a record torn by a kill is simply skipped.
+// Slots of exited threads are only recycled once every slot has been handed out.
+
+#ifndef HEAL_FLIGHT_NAMES
+#define HEAL_FLIGHT_NAMES 96
+#endif
+
+#ifndef HEAL_FLIGHT_MODULE_BYTES
+#define HEAL_FLIGHT_MODULE_BYTES (64 * 1024)
+#endif
+
+#ifndef HEAL_FLIGHT_STACK_BYTES
+#define HEAL_FLIGHT_STACK_BYTES (256 * 1024)
+#endif
+
+#ifndef HEAL_FLIGHT_STACK_SLOTS
+#define HEAL_FLIGHT_STACK_SLOTS 4096        // distinct stacks remembered as already written
+#endif
+
+#if $on($linux)
+
+namespace {
+
+    struct flight_name {
+        uint32_t event;
+        std::atomic<uint32_t> ready;
+        char name[24];
+    };
+
+    struct flight_header {
+        char magic[8];                      // "HEALFLT1", written last
+        uint32_t version, pid, threads, capacity;
+        uint64_t stamp0, ns0;               // cycles() and realtime at open()
+        double cycles_per_ns;
+        uint64_t modules, stacks, slots;    // file offsets
+        uint32_t modules_size, stacks_size;
+        std::atomic<uint32_t> threads_used, names_used, stacks_used;
+        uint32_t reserved;
+        char exe[256];
+        flight_name names[ HEAL_FLIGHT_NAMES ];
+    };
+
+    struct flight_slot {
+        enum { unused, live, exited };
+        std::atomic<uint32_t> state;
+        uint32_t tid;
+        std::atomic<uint64_t> head;         // events ever recorded
+        char name[16];
+        char padding[ 64 - 32 ];
+    };
+
+    struct flight_event {
+        std::atomic<uint64_t> seq;          // position + 1, stored last
+        uint64_t stamp;
+        uint32_t event, stack;
+        uint64_t words[4];
+        uint64_t reserved;
+    };
+
+    static_assert( sizeof(flight_header) <= 4096, "flight recorder header must fit in one page" );
+    static_assert( sizeof(flight_slot) == 64 && sizeof(flight_event) == 64, "flight recorder records are 64 bytes" );
+
+    std::atomic<char *> flight_base( 0 );
+    std::atomic<uint32_t> flight_stacks_seen[ HEAL_FLIGHT_STACK_SLOTS ];
+    int flight_fd = -1;
+    std::mutex flight_mutex;
+
+    flight_slot *flight_slot_at( char *base, uint32_t index ) {
+        flight_header *h = (flight_header *)base;
+        return (flight_slot *)( base + h->slots + uint64_t( index ) * ( sizeof(flight_slot) + h->capacity * sizeof(flight_event) ) );
+    }
+
+    std::atomic<uint32_t> flight_exits( 0 ); // slots given back; threads left without one retry when it moves
+
+    struct flight_thread {
+        char *base;
+        flight_slot *slot;
+        uint32_t exits_seen; // no slot: flight_exits as of the failed claim
+        ~flight_thread() {
+            if( slot && base == flight_base.load() ) slot->state = flight_slot::exited, flight_exits++;
+        }
+    };
+    thread_local flight_thread flight_self = { 0, 0, 0 };
+
+    // first event of this thread since open(): fresh slot if any left, else the slot of an exited thread.
+    // reads the tid and thread name, the only syscalls of the recorder
+    flight_slot *claim_flight_slot( char *base ) {
+        flight_header *h = (flight_header *)base;
+        flight_slot *slot = 0;
+        uint32_t exits = flight_exits.load();
+        uint32_t index = h->threads_used.load() < h->threads ? h->threads_used.fetch_add( 1 ) : h->threads;
+        if( index < h->threads ) slot = flight_slot_at( base, index );
+        else for( uint32_t i = 0; i < h->threads && !slot; ++i ) {
+            uint32_t expected = flight_slot::exited;
+            if( flight_slot_at( base, i )->state.compare_exchange_strong( expected, flight_slot::unused ) ) slot = flight_slot_at( base, i );
+        }
+        flight_self.base = base, flight_self.slot = slot, flight_self.exits_seen = exits;
+        if( !slot ) return 0;
+        flight_event *ring = (flight_event *)( slot + 1 );
+        for( uint32_t i = 0; i < h->capacity; ++i ) ring[i].seq.store( 0, std::memory_order_relaxed );
+        slot->head.store( 0, std::memory_order_relaxed );
+        slot->tid = current_tid();
+        prctl( PR_GET_NAME, slot->name );
+        slot->state.store( flight_slot::live, std::memory_order_release );
+        return slot;
+    }
+
+    // copy the frames of `stack` into the file, once per stack
+    void write_flight_stack( char *base, stackid stack ) {
+        uint32_t i = ( stack.id * 2654435761u ) % HEAL_FLIGHT_STACK_SLOTS;
+        for( unsigned probe = 0; probe < 16; ++probe, i = ( i + 1 ) % HEAL_FLIGHT_STACK_SLOTS ) {
+            uint32_t seen = flight_stacks_seen[i].load( std::memory_order_relaxed );
+            if( seen == stack.id ) return;
+            if( !seen ) {
+                if( flight_stacks_seen[i].compare_exchange_strong( seen, stack.id ) ) break;
+                if( seen == stack.id ) return;
+            }
+        }
+        flight_header *h = (flight_header *)base;
+        uint32_t count = uint32_t( stack.size() ), bytes = 8 + count * 8;
+        uint32_t offset = h->stacks_used.fetch_add( bytes );
+        if( uint64_t( offset ) + bytes > h->stacks_size ) return;
+        char *p = base + h->stacks + offset;
+        std::memcpy( p + 4, &count, 4 );
+        void * const *frames = stack.frames();
+        for( uint32_t f = 0; f < count; ++f ) {
+            uint64_t addr = uint64_t( uintptr_t( frames[f] ) );
+            std::memcpy( p + 8 + f * 8, &addr, 8 );
+        }
+        ((std::atomic<uint32_t> *)p)->store( stack.id, std::memory_order_release );
+    }
+
+    void record_flight( uint32_t event, stackid stack, uint64_t a, uint64_t b, uint64_t c, uint64_t d ) {
+        char *base = flight_base.load( std::memory_order_acquire );
+        if( !base ) return;
+        flight_slot *slot = flight_self.slot;
+        if( $unlikely( flight_self.base != base || !slot ) ) {
+            if( flight_self.base == base && flight_exits.load( std::memory_order_relaxed ) == flight_self.exits_seen ) return; // still no room
+            if( !( slot = claim_flight_slot( base ) ) ) return;
+        }
+        if( stack.id ) write_flight_stack( base, stack );
+
+        flight_header *h = (flight_header *)base;
+        uint64_t head = slot->head.load( std::memory_order_relaxed );
+        flight_event &e = ( (flight_event *)( slot + 1 ) )[ head & ( h->capacity - 1 ) ];
+        e.seq.store( 0, std::memory_order_relaxed );
+        std::atomic_signal_fence( std::memory_order_release );
+        e.stamp = binlog::cycles();
+        e.event = event, e.stack = stack.id;
+        e.words[0] = a, e.words[1] = b, e.words[2] = c, e.words[3] = d;
+        e.seq.store( head + 1, std::memory_order_release );
+        slot->head.store( head + 1, std::memory_order_relaxed );
+    }
+}
+
+bool flight_recorder::open( const std::string &path, unsigned threads, unsigned events_per_thread ) {
+    std::lock_guard<std::mutex> lock( flight_mutex );
+    if( flight_base.load() || !threads ) return false;
+    uint32_t capacity = 2;
+    while( capacity < events_per_thread ) capacity *= 2;
+
+    uint64_t slots = 4096 + HEAL_FLIGHT_MODULE_BYTES + HEAL_FLIGHT_STACK_BYTES;
+    uint64_t size = slots + uint64_t( threads ) * ( sizeof(flight_slot) + capacity * sizeof(flight_event) );
+    int fd = ::open( path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 );
+    if( fd < 0 ) return false;
+    // reserve the blocks now: a full disk (ENOSPC, EFBIG) must fail here, not SIGBUS a writer later.
+    // only a filesystem that cannot reserve at all (EOPNOTSUPP, EINVAL) gets a sparse file instead
+    int err;
+    while( ( err = posix_fallocate( fd, 0, off_t( size ) ) ) == EINTR ) {}
+    if( err && ( ( err != EOPNOTSUPP && err != EINVAL ) || ftruncate( fd, off_t( size ) ) != 0 ) ) {
+        ::close( fd );
+        return false;
+    }
+    void *map = mmap( 0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    if( map == MAP_FAILED ) {
+        ::close( fd );
+        return false;
+    }
+    char *base = (char *)map;
+    flight_header *h = (flight_header *)base;
+    h->version = 1, h->pid = uint32_t( getpid() ), h->threads = threads, h->capacity = capacity;
+    h->modules = 4096, h->modules_size = HEAL_FLIGHT_MODULE_BYTES;
+    h->stacks = 4096 + HEAL_FLIGHT_MODULE_BYTES, h->stacks_size = HEAL_FLIGHT_STACK_BYTES;
+    h->slots = slots;
+    std::string exe = symbolizer::executable(), modules = module_snapshot();
+    std::memcpy( base + h->modules, modules.data(), (std::min)( modules.size(), size_t( HEAL_FLIGHT_MODULE_BYTES - 1 ) ) );
+    std::memcpy( h->exe, exe.data(), (std::min)( exe.size(), sizeof(h->exe) - 1 ) );
+    for( unsigned i = 0; i < HEAL_FLIGHT_STACK_SLOTS; ++i ) flight_stacks_seen[i] = 0;
+
+    // cycles() to wall clock: two points 10 ms apart
+    uint64_t stamp0 = binlog::cycles();
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    h->ns0 = uint64_t( std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::system_clock::now().time_since_epoch() ).count() );
+    std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+    uint64_t stamp1 = binlog::cycles();
+    double ns = double( std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - t0 ).count() );
+    h->stamp0 = stamp0;
+    h->cycles_per_ns = stamp1 > stamp0 && ns > 0 ? double( stamp1 - stamp0 ) / ns : 1.0;
+
+    std::memcpy( h->magic, "HEALFLT1", 8 );
+    flight_fd = fd;
+    flight_base.store( base, std::memory_order_release );
+    return true;
+}
+
+// the mapping is left in place, so threads still inside record() stay safe
+void flight_recorder::close() {
+    std::lock_guard<std::mutex> lock( flight_mutex );
+    char *base = flight_base.exchange( 0 );
+    if( !base ) return;
+    ::close( flight_fd );
+    flight_fd = -1;
+}
+
+void flight_recorder::name( uint32_t event, const char *name ) {
+    std::lock_guard<std::mutex> lock( flight_mutex );
+    char *base = flight_base.load();
+    if( !base || !name ) return;
+    flight_header *h = (flight_header *)base;
+    uint32_t used = h->names_used.load(), i = 0;
+    while( i < used && h->names[i].event != event ) ++i;
+    if( i == HEAL_FLIGHT_NAMES ) return;
+    flight_name &n = h->names[i];
+    n.ready.store( 0, std::memory_order_relaxed );
+    n.event = event;
+    std::memset( n.name, 0, sizeof(n.name) );
+    std::strncpy( n.name, name, sizeof(n.name) - 1 );
+    n.ready.store( 1, std::memory_order_release );
+    if( i == used ) h->names_used.store( used + 1 );
+}
+
+bool flight_recorder::register_thread() {
+    char *base = flight_base.load( std::memory_order_acquire );
+    if( !base ) return false;
+    if( flight_self.base == base && flight_self.slot ) return true;
+    return claim_flight_slot( base ) != 0;
+}
+
+void flight_recorder::record( uint32_t event, uint64_t a, uint64_t b, uint64_t c, uint64_t d ) {
+    record_flight( event, stackid(), a, b, c, d );
+}
+
+void flight_recorder::record( uint32_t event, stackid stack, uint64_t a, uint64_t b, uint64_t c, uint64_t d ) {
+    record_flight( event, stack, a, b, c, d );
+}
+
+std::string flight_recorder::decode( std::istream &is ) {
+    std::string raw( ( std::istreambuf_iterator<char>( is ) ), std::istreambuf_iterator<char>() );
+    std::vector<uint64_t> aligned( raw.size() / 8 + 1 );
+    std::memcpy( &aligned[0], raw.data(), raw.size() );
+    const char *base = (const char *)&aligned[0];
+    const flight_header *h = (const flight_header *)base;
+    if( raw.size() < 4096 || std::memcmp( h->magic, "HEALFLT1", 8 ) || h->version != 1 ) return "not a heal flight recorder file\n";
+    uint64_t slot_size = sizeof(flight_slot) + uint64_t( h->capacity ) * sizeof(flight_event);
+    if( !h->capacity || ( h->capacity & ( h->capacity - 1 ) ) || h->slots + h->threads * slot_size > raw.size() ) return "truncated heal flight recorder file\n";
+
+    std::map< uint32_t, std::string > names;
+    for( uint32_t i = 0; i < (std::min)( h->names_used.load(), uint32_t( HEAL_FLIGHT_NAMES ) ); ++i )
+        if( h->names[i].ready.load() ) names[ h->names[i].event ] = std::string( h->names[i].name, strnlen( h->names[i].name, sizeof(h->names[i].name) ) );
+
+    std::map< uint32_t, std::string > stacks;
+    std::string modules( base + h->modules, strnlen( base + h->modules, h->modules_size ) );
+    for( uint64_t offset = 0, used = (std::min)( h->stacks_used.load(), h->stacks_size ); offset + 8 <= used; ) {
+        const char *p = base + h->stacks + offset;
+        uint32_t id = ((const std::atomic<uint32_t> *)p)->load(), count;
+        std::memcpy( &count, p + 4, 4 );
+        if( !count || offset + 8 + count * 8ull > used ) break;
+        if( id ) {
+            std::vector<void *> frames( count );
+            for( uint32_t f = 0; f < count; ++f ) {
+                uint64_t addr;
+                std::memcpy( &addr, p + 8 + f * 8, 8 );
+                frames[f] = (void *)uintptr_t( addr );
+            }
+            stacks[ id ] = modules + dump_stack( &frames[0], count );
+        }
+        offset += 8 + count * 8ull;
+    }
+
+    struct event {
+        uint64_t stamp;
+        const flight_slot *slot;
+        const flight_event *e;
+        bool operator<( const event &other ) const { return stamp < other.stamp; }
+    };
+    std::vector< event > events;
+    std::string out = heal::sfstring( "# flight recorder: pid \1 (\2), \3 events per thread\n", h->pid, h->exe, h->capacity );
+    for( uint32_t t = 0, used = (std::min)( h->threads_used.load(), h->threads ); t < used; ++t ) {
+        const flight_slot *slot = (const flight_slot *)( base + h->slots + t * slot_size );
+        if( slot->state.load() == flight_slot::unused ) continue;
+        const flight_event *ring = (const flight_event *)( slot + 1 );
+        uint64_t head = slot->head.load();
+        out += heal::sfstring( "# thread \1 (\2): \3 events\4\5\n", slot->tid, std::string( slot->name, strnlen( slot->name, sizeof(slot->name) ) ), head,
+            head > h->capacity ? heal::sfstring( ", \1 overwritten", head - h->capacity ) : std::string(), slot->state.load() == flight_slot::exited ? ", exited" : "" );
+        for( uint32_t i = 0; i < h->capacity; ++i ) {
+            uint64_t seq = ring[i].seq.load();
+            if( seq && ( ( seq - 1 ) & ( h->capacity - 1 ) ) == i ) {
+                event ev = { ring[i].stamp, slot, &ring[i] };
+                events.push_back( ev );
+            }
+        }
+    }
+    std::stable_sort( events.begin(), events.end() );
+
+    std::map< uint32_t, std::string > symbolized;
+    for( size_t i = 0; i < events.size(); ++i ) {
+        const flight_event &e = *events[i].e;
+        int64_t delta = int64_t( ( double( e.stamp ) - double( h->stamp0 ) ) / h->cycles_per_ns );
+        uint64_t ns = h->ns0 + uint64_t( delta );
+        char line[128];
+        sprintf( line, "%llu.%09llu %u ", (unsigned long long)( ns / 1000000000 ), (unsigned long long)( ns % 1000000000 ), events[i].slot->tid );
+        out += line;
+        std::map< uint32_t, std::string >::const_iterator found = names.find( e.event );
+        out += found != names.end() ? found->second : heal::sfstring( "#\1", e.event );
+        unsigned words = 4;
+        while( words && !e.words[ words - 1 ] ) --words;
+        for( unsigned w = 0; w < words; ++w ) out += heal::sfstring( " \1", e.words[w] );
+        out += '\n';
+        if( !e.stack ) continue;
+        if( !symbolized.count( e.stack ) ) {
+            std::map< uint32_t, std::string >::const_iterator dump = stacks.find( e.stack );
+            std::stringstream ss( dump != stacks.end() ? dump->second : std::string() );
+            symbolized[ e.stack ] = dump != stacks.end() ? symbolize_dump( ss, "    #\1 \2\n" ) : heal::sfstring( "    (stack \1 not recorded)\n", e.stack );
+        }
+        out += symbolized[ e.stack ];
+    }
+    return out;
+}
 
-                // RtlCaptureStackBackTrace is only available on Windows XP or newer versions of Windows
-                typedef WORD(NTAPI FuncRtlCaptureStackBackTrace)(DWORD, DWORD, PVOID *, PDWORD);
+#else
 
-                static struct raii
-                {
-                    raii() : module(0), ptrRtlCaptureStackBackTrace(0)
-                    {
-                        module = LoadLibraryA("kernel32.dll");
-                        if( !module )
-                            fail( "<heal/heal.cpp> says: error! cant load kernel32.dll" );
+bool flight_recorder::open( const std::string &, unsigned, unsigned ) {
+    return false;
+}
+void flight_recorder::close()
+{}
+void flight_recorder::name( uint32_t, const char * )
+{}
+bool flight_recorder::register_thread() {
+    return false;
+}
+void flight_recorder::record( uint32_t, uint64_t, uint64_t, uint64_t, uint64_t )
+{}
+void flight_recorder::record( uint32_t, stackid, uint64_t, uint64_t, uint64_t, uint64_t )
+{}
+std::string flight_recorder::decode( std::istream & ) {
+    return std::string();
+}
 
-                        ptrRtlCaptureStackBackTrace = (FuncRtlCaptureStackBackTrace *)GetProcAddress(module, "RtlCaptureStackBackTrace");
-                        if( !ptrRtlCaptureStackBackTrace )
-                            fail( "<heal/heal.cpp> says: error! cant find RtlCaptureStackBackTrace() process address" );
-                    }
-                    ~raii() { if(module) FreeLibrary(module); }
+#endif
 
-                    HMODULE module;
-                    FuncRtlCaptureStackBackTrace *ptrRtlCaptureStackBackTrace;
-                } module;
+// PROFILER
+// SIGPROF sampling profiler. The signal handler unwinds the interrupted context into a per-thread,
+// single-producer/single-consumer ring (preallocated; claimed lock-free on first sample of each thread).
+// A background thread drains the rings, interns stacks in the stack depot and counts them.
+// dump() prints collapsed "folded stacks", ready for flamegraph.pl and friends.
+// In wall-clock mode a sampler thread visits every registered thread at a fixed real-time rate, and tags
+// each sample with the thread state read from /proc/self/task/<tid>/stat. Only running threads get a signal.
+// Blocked ones are left in their syscall: their pc and sp come from /proc/self/task/<tid>/syscall, and the
+// sampler unwinds a copy of their stack with CFI. Frames that need the (unknown) frame pointer end it there.
+
+#ifndef HEAL_PROFILER_MAX_THREADS
+#define HEAL_PROFILER_MAX_THREADS 64
+#endif
+#ifndef HEAL_PROFILER_RING_SIZE
+#define HEAL_PROFILER_RING_SIZE 256
+#endif
+#ifndef HEAL_PROFILER_MAX_DEPTH
+#define HEAL_PROFILER_MAX_DEPTH 64
+#endif
+#ifndef HEAL_PROFILER_STACK_COPY
+#define HEAL_PROFILER_STACK_COPY (32 * 1024) // bytes of a blocked thread's stack unwound in wall mode
+#endif
 
-                if( module.ptrRtlCaptureStackBackTrace )
-                    capturedFrames = module.ptrRtlCaptureStackBackTrace(frames_to_skip+1, max_frames, out_frames, (DWORD *) 0);
+#if $on($unwinder)
 
-                frames.resize( capturedFrames );
-                std::vector<void *>(frames).swap(frames);
-                return;
-            })
-            $gnuc({ 
-                // Ensure the output is cleared
-                std::memset(out_frames, 0, (sizeof(void *)) * max_frames);
+namespace {
 
-                frames.resize( backtrace(out_frames, max_frames) );
-                std::vector<void *>(frames).swap(frames);
-                return;
-            })
+    struct profiler_state {
+        struct sample {
+            uint32_t depth, tag;
+            void *frames[ HEAL_PROFILER_MAX_DEPTH ];
+        };
+        struct ring {
+            std::atomic<pid_t> owner;
+            std::atomic<uint32_t> head, tail; // head: written by the signal handler; tail: by the aggregator
+            std::atomic<uint32_t> pending_tag; // wall mode: thread state, written by the sampler before signaling
+            std::atomic<bool> registered;
+            sample samples[ HEAL_PROFILER_RING_SIZE ];
+        };
+
+        ring *rings; // mmap'ed once, never released: a late signal may still be writing into them
+        std::atomic<bool> running;
+        std::atomic<int> mode;
+        unsigned hz;
+        std::atomic<uint64_t> dropped;
+        std::mutex mutex; // guards counts and the aggregator thread
+        std::map< std::pair< stackid, uint32_t >, uint64_t > counts;
+        std::thread aggregator;
+        struct sigaction previous;
+        std::vector<char> stack_copy; // wall mode, sampler thread only
+
+        bool allocate() {
+            if( rings ) return true;
+            void *ptr = mmap( 0, sizeof(ring) * HEAL_PROFILER_MAX_THREADS, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+            return ptr != MAP_FAILED && ( rings = (ring *)ptr ) != 0;
+        }
+
+        void drain() {
+            std::vector< std::pair< std::pair< stackid, uint32_t >, uint64_t > > batch;
+            for( unsigned r = 0; r < HEAL_PROFILER_MAX_THREADS; ++r ) {
+                ring &rg = rings[r];
+                if( !rg.owner.load( std::memory_order_acquire ) ) continue;
+                uint32_t tail = rg.tail.load( std::memory_order_relaxed ), head = rg.head.load( std::memory_order_acquire );
+                for( ; tail != head; ++tail ) {
+                    const sample &s = rg.samples[ tail % HEAL_PROFILER_RING_SIZE ];
+                    batch.push_back( std::make_pair( std::make_pair( intern( s.frames, s.depth ), s.tag ), 1 ) );
+                }
+                rg.tail.store( tail, std::memory_order_release );
+            }
+            std::lock_guard<std::mutex> lock( mutex );
+            for( size_t i = 0; i < batch.size(); ++i ) counts[ batch[i].first ] += batch[i].second;
+        }
+
+        // give slots of finished threads back
+        void reclaim() {
+            for( unsigned r = 0; r < HEAL_PROFILER_MAX_THREADS; ++r ) {
+                pid_t tid = rings[r].owner.load( std::memory_order_acquire );
+                if( tid && rings[r].head.load() == rings[r].tail.load() && !file::exists( "/proc/self/task/" + std::to_string( tid ) ) ) {
+                    rings[r].registered = false;
+                    rings[r].owner.compare_exchange_strong( tid, 0 );
+                }
+            }
+        }
+
+        // thread state letter from /proc/self/task/<tid>/stat: R running, S sleeping, D disk, ...
+        static char thread_state( pid_t tid ) {
+            char path[64], buf[512];
+            sprintf( path, "/proc/self/task/%d/stat", int(tid) );
+            int fd = open( path, O_RDONLY | O_CLOEXEC );
+            if( fd < 0 ) return 0;
+            ssize_t len = read( fd, buf, sizeof(buf) - 1 );
+            close( fd );
+            if( len <= 0 ) return 0;
+            buf[ len ] = 0;
+            const char *paren = strrchr( buf, ')' ); // comm may contain spaces and parens
+            return paren && paren[1] == ' ' ? paren[2] : 0;
+        }
+
+        // up to HEAL_PROFILER_STACK_COPY bytes from `from` on, stopping at the first unmapped page
+        size_t copy_stack( uintptr_t from ) {
+            enum { page = 4096, pieces = HEAL_PROFILER_STACK_COPY / page + 1 };
+            if( stack_copy.empty() ) stack_copy.resize( HEAL_PROFILER_STACK_COPY );
+            struct iovec local = { &stack_copy[0], stack_copy.size() }, remote[ pieces ];
+            unsigned n = 0;
+            for( size_t left = stack_copy.size(); left && n < pieces; ++n ) { // partial reads stop at iovec boundaries
+                size_t chunk = (std::min)( left, size_t( page - from % page ) );
+                remote[n].iov_base = (void *)from, remote[n].iov_len = chunk;
+                from += chunk, left -= chunk;
+            }
+            ssize_t got = process_vm_readv( getpid(), &local, 1, remote, n, 0 );
+            return got > 0 ? size_t( got ) : 0;
+        }
+
+        // a blocked thread, sampled without interrupting its syscall. false if it turns out to be running
+        bool sample_blocked( pid_t tid, uint32_t state, std::vector< std::pair< stackid, uint32_t > > &out ) {
+            char path[64], buf[256];
+            sprintf( path, "/proc/self/task/%d/syscall", int(tid) );
+            int fd = open( path, O_RDONLY | O_CLOEXEC );
+            if( fd < 0 ) return false;
+            ssize_t len = read( fd, buf, sizeof(buf) - 1 );
+            close( fd );
+            if( len <= 0 || buf[0] == 'r' ) return false; // "running"
+            buf[ len ] = 0;
+            // "nr args... sp pc", or "-1 sp pc" when blocked outside of a syscall
+            unsigned long long fields[ 9 ];
+            unsigned n = 0;
+            for( char *p = buf, *end; n < 9; p = end, ++n ) {
+                fields[n] = strtoull( p, &end, 0 );
+                if( end == p ) break;
+            }
+            if( n < 3 ) return false;
+            uintptr_t sp = uintptr_t( fields[ n - 2 ] ), pc = uintptr_t( fields[ n - 1 ] );
+
+            void *frames[ HEAL_PROFILER_MAX_DEPTH ];
+            unsigned depth = 0;
+            frames[ depth++ ] = (void *)pc;
+            #if defined(__x86_64__)
+            if( current_unwinder.load( std::memory_order_relaxed ) != framepointer_unwinder ) {
+                uintptr_t from = sp & ~uintptr_t(15);
+                if( size_t got = copy_stack( from ) ) {
+                    uintptr_t base = uintptr_t( &stack_copy[0] );
+                    unwind_regs regs = { pc, base + ( sp - from ), 0 };
+                    stack_bounds bounds = { base, base + got };
+                    depth += unwind_eh( regs, bounds, frames + 1, HEAL_PROFILER_MAX_DEPTH - 1, 0, false, intptr_t( base - from ) );
+                }
+            }
+            #endif
+            out.push_back( std::make_pair( intern( frames, depth ), state ) );
+            return true;
+        }
+
+        void sample_registered() {
+            std::vector< std::pair< stackid, uint32_t > > blocked;
+            for( unsigned r = 0; r < HEAL_PROFILER_MAX_THREADS; ++r ) {
+                pid_t tid = rings[r].owner.load( std::memory_order_acquire );
+                if( !tid || !rings[r].registered.load( std::memory_order_acquire ) ) continue;
+                uint32_t state = uint32_t( thread_state( tid ) );
+                if( state && state != 'R' && sample_blocked( tid, state, blocked ) ) continue;
+                rings[r].pending_tag.store( state, std::memory_order_release );
+                if( syscall( SYS_tgkill, getpid(), tid, SIGPROF ) != 0 ) rings[r].registered = false;
+            }
+            if( blocked.empty() ) return;
+            std::lock_guard<std::mutex> lock( mutex );
+            for( size_t i = 0; i < blocked.size(); ++i ) counts[ blocked[i] ]++;
+        }
+
+        void loop() {
+            std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+            std::chrono::microseconds period( mode == profiler::wall ? 1000000 / hz : 10000 );
+            for( unsigned ticks = 0; running; ++ticks ) {
+                if( mode == profiler::wall ) sample_registered();
+                std::this_thread::sleep_until( next += period );
+                drain();
+                if( ticks % 1000 == 999 ) reclaim();
+            }
+            drain();
+        }
+    };
+
+    profiler_state &get_profiler() {
+        static profiler_state *state = new profiler_state(); // leaked on purpose; signals may arrive late
+        return *state;
+    }
+
+    $tls( int profiler_slot ) = -1;
+    $tls( pid_t profiler_tid ) = 0;
+
+    // async-signal-safe
+    profiler_state::ring *claim_ring( profiler_state &p ) {
+        if( profiler_slot >= 0 ) return &p.rings[ profiler_slot ];
+        if( !profiler_tid ) profiler_tid = pid_t( syscall( SYS_gettid ) );
+        for( int r = 0; r < HEAL_PROFILER_MAX_THREADS; ++r ) {
+            pid_t expected = 0;
+            if( p.rings[r].owner.compare_exchange_strong( expected, profiler_tid ) ) {
+                p.rings[r].head.store( p.rings[r].tail.load() );
+                return &p.rings[ profiler_slot = r ];
+            }
+        }
+        return 0;
+    }
+
+    void profiler_record( const void *context, uint32_t tag ) {
+        profiler_state &p = get_profiler();
+        if( !p.rings || !p.running.load( std::memory_order_relaxed ) ) return;
+        profiler_state::ring *rg = claim_ring( p );
+        if( !rg ) return p.dropped++, void();
+        uint32_t head = rg->head.load( std::memory_order_relaxed );
+        if( head - rg->tail.load( std::memory_order_acquire ) >= HEAL_PROFILER_RING_SIZE ) return p.dropped++, void();
+        profiler_state::sample &s = rg->samples[ head % HEAL_PROFILER_RING_SIZE ];
+        s.depth = capture_context( context, s.frames, HEAL_PROFILER_MAX_DEPTH );
+        s.tag = p.mode.load( std::memory_order_relaxed ) == profiler::wall ? rg->pending_tag.load( std::memory_order_acquire ) : tag;
+        rg->head.store( head + 1, std::memory_order_release );
+    }
+
+    void on_sigprof( int, siginfo_t *, void *context ) {
+        int saved_errno = errno;
+        profiler_record( context, 0 );
+        errno = saved_errno;
+    }
+
+    // function name only; drop the " (file:line)" suffix and characters that would break the folded format
+    std::string folded_name( const std::string &symbol ) {
+        std::string name = symbol;
+        std::string::size_type paren = name.rfind( " (" );
+        if( paren != std::string::npos && paren > 0 && name[ name.size() - 1 ] == ')' ) name.resize( paren );
+        std::replace( name.begin(), name.end(), ';', ':' );
+        std::replace( name.begin(), name.end(), '\n', ' ' );
+        return name;
+    }
+
+    std::string folded_state( uint32_t tag ) {
+        switch( tag ) {
+            case 0: return std::string();
+            case 'R': return "[running];";
+            case 'S': return "[sleeping];";
+            case 'D': return "[disk];";
+            case 'T': case 't': return "[stopped];";
         }
+        return std::string( "[state " ) + char( tag ) + "];";
+    }
+}
+
+#endif
+
+bool profiler::start( unsigned hz, mode m ) {
+    $unwinder({
+        profiler_state &p = get_profiler();
+        std::lock_guard<std::mutex> lock( p.mutex );
+        if( p.running || !hz || hz > 1000000 || !p.allocate() ) return false;
+        current_stack_bounds();
+        sync_modules(); // samples read the module table, and cannot refresh it themselves
+        p.counts.clear();
+        p.dropped = 0;
+        p.mode = m;
+        p.hz = hz;
+        p.running = true;
+
+        struct sigaction sa;
+        std::memset( &sa, 0, sizeof(sa) );
+        sa.sa_sigaction = on_sigprof;
+        sa.sa_flags = SA_SIGINFO | SA_RESTART;
+        sigemptyset( &sa.sa_mask );
+        sigaction( SIGPROF, &sa, &p.previous );
+
+        if( m == cpu ) {
+            struct itimerval timer;
+            timer.it_interval.tv_sec = 1 / hz;
+            timer.it_interval.tv_usec = ( 1000000 / hz ) % 1000000;
+            timer.it_value = timer.it_interval;
+            if( setitimer( ITIMER_PROF, &timer, 0 ) != 0 ) {
+                sigaction( SIGPROF, &p.previous, 0 );
+                p.running = false;
+                return false;
+            }
+        }
+        p.aggregator = std::thread( &profiler_state::loop, &p );
+        return true;
+    })
+    return false;
+}
 
-        std::vector<std::string> callstack::unwind( unsigned from, unsigned to ) const
+void profiler::stop() {
+    $unwinder({
+        profiler_state &p = get_profiler();
+        std::thread aggregator;
         {
-            if( to == ~0 )
-                to = this->frames.size();
+            std::lock_guard<std::mutex> lock( p.mutex );
+            if( !p.running ) return;
+            struct itimerval timer;
+            std::memset( &timer, 0, sizeof(timer) );
+            setitimer( ITIMER_PROF, &timer, 0 );
+            p.running = false;
+            aggregator.swap( p.aggregator );
+        }
+        aggregator.join(); // the wall-mode sampler runs there too: no more tgkill() after this
+
+        // a SIGPROF sent before may still be pending on some thread. ignoring the signal discards it,
+        // so the previous action (often the default one, which terminates) never sees it
+        std::lock_guard<std::mutex> lock( p.mutex );
+        if( p.running ) return; // restarted meanwhile
+        struct sigaction ignore;
+        std::memset( &ignore, 0, sizeof(ignore) );
+        ignore.sa_handler = SIG_IGN;
+        sigemptyset( &ignore.sa_mask );
+        sigaction( SIGPROF, &ignore, 0 );
+        sigaction( SIGPROF, &p.previous, 0 );
+    })
+}
 
-            if( from > to || from > this->frames.size() || to > this->frames.size() )
-                return std::vector<std::string>();
+void profiler::register_thread() {
+    $unwinder({
+        profiler_state &p = get_profiler();
+        {
+            std::lock_guard<std::mutex> lock( p.mutex );
+            if( !p.allocate() ) return;
+        }
+        current_stack_bounds();
+        profiler_state::ring *rg = claim_ring( p );
+        if( rg ) rg->registered = true;
+    })
+}
 
-            const size_t num_frames = to - from;
-            std::vector<std::string> backtraces( num_frames );
+void profiler::unregister_thread() {
+    $unwinder({
+        profiler_state &p = get_profiler();
+        if( p.rings && profiler_slot >= 0 ) p.rings[ profiler_slot ].registered = false;
+    })
+}
+
+std::string profiler::dump() {
+    std::string out;
+    $unwinder({
+        profiler_state &p = get_profiler();
+        std::map< std::pair< stackid, uint32_t >, uint64_t > counts;
+        {
+            std::lock_guard<std::mutex> lock( p.mutex );
+            counts = p.counts;
+        }
+        std::map< std::string, uint64_t > folded;
+        for( std::map< std::pair< stackid, uint32_t >, uint64_t >::const_iterator it = counts.begin(); it != counts.end(); ++it ) {
+            std::vector<std::string> frames = it->first.first.unwind();
+            std::string line = folded_state( it->first.second );
+            for( size_t i = frames.size(); i--; ) {
+                line += folded_name( frames[i] );
+                if( i ) line += ';';
+            }
+            folded[ line ] += it->second;
+        }
+        for( std::map< std::string, uint64_t >::const_iterator it = folded.begin(); it != folded.end(); ++it ) {
+            out += it->first + " " + std::to_string( it->second ) + "\n";
+        }
+    })
+    return out;
+}
+
+// ALLOCATIONS
+// Opt-in heap tracker. Build heal.cpp with HEAL_TRACK_ALLOCATIONS defined to replace global operator new/delete
+// and, on glibc, interpose malloc/calloc/realloc/free (see the hooks at the bottom of this file).
+// Every tracked allocation gets its size and an interned callstack; snapshots group live bytes by callstack.
+// In sampling mode only one allocation every ~N bytes is tracked (poisson process over allocated bytes), so
+// unsampled mallocs cost a thread-local countdown and unsampled frees a probe into a lock-free pointer set.
+
+#ifndef HEAL_ALLOCATION_DEPTH
+#define HEAL_ALLOCATION_DEPTH 32
+#endif
+
+#ifndef HEAL_HEAP_SAMPLE_SLOTS
+#define HEAL_HEAP_SAMPLE_SLOTS (1 << 16)     // max sampled live objects at once
+#endif
+
+namespace {
+
+    std::atomic<bool> tracking_allocations( false );
+    std::atomic<size_t> allocation_sample_interval( 0 ); // 0 tracks everything
+    $tls( int allocation_hook_depth ) = 0;
+    $tls( int64_t bytes_until_sample ) = 0;
+    $tls( uint64_t sampler_state ) = 0;
+
+    // allocations made by the tracker itself are not tracked
+    struct hook_guard {
+        hook_guard() { ++allocation_hook_depth; }
+        ~hook_guard() { --allocation_hook_depth; }
+    };
+
+    // exponentially distributed distance to the next sample, mean `interval` bytes
+    int64_t next_sample_distance( size_t interval ) {
+        uint64_t x = sampler_state;
+        x ^= x << 13, x ^= x >> 7, x ^= x << 17;
+        sampler_state = x;
+        double u = ( ( x >> 11 ) + 0.5 ) / 9007199254740992.0; // (0,1)
+        return int64_t( -std::log( u ) * interval ) + 1;
+    }
+
+    // countdown expired. rearm it and tell whether this allocation is a sample.
+    bool rearm_sampler( size_t interval ) {
+        bool seeded = sampler_state != 0;
+        if( !seeded ) {
+            sampler_state = uint64_t( uintptr_t( &sampler_state ) ) ^ uint64_t( std::chrono::steady_clock::now().time_since_epoch().count() );
+            sampler_state |= 1;
+        }
+        bytes_until_sample = next_sample_distance( interval );
+        return seeded;
+    }
+
+    // a sample of `size` bytes stands for 1/p allocations, p being its odds to be picked
+    float sample_scale( size_t size, size_t interval ) {
+        if( !interval ) return 1.f;
+        double p = 1.0 - std::exp( -double( size ) / double( interval ) );
+        return p > 0 ? float( 1.0 / p ) : float( interval );
+    }
+
+    // fixed-size open addressing set of sampled pointers. frees probe it without locking.
+    struct sampled_set {
+        enum { slots = HEAL_HEAP_SAMPLE_SLOTS, probes = 32 };
+        enum { empty = 0, erased = 1 };
+        std::atomic<uintptr_t> table[ slots ];
+
+        static size_t slot( const void *ptr ) {
+            uint64_t h = uint64_t( uintptr_t( ptr ) ) * 0x9E3779B97F4A7C15ull;
+            return size_t( h >> 32 ) % slots;
+        }
+        bool insert( const void *ptr ) {
+            for( size_t i = slot( ptr ), n = 0; n < probes; ++n, i = ( i + 1 ) % slots ) {
+                uintptr_t seen = table[i].load( std::memory_order_relaxed );
+                if( ( seen == empty || seen == erased ) && table[i].compare_exchange_strong( seen, uintptr_t( ptr ) ) ) return true;
+            }
+            return false;
+        }
+        bool erase( const void *ptr ) {
+            for( size_t i = slot( ptr ), n = 0; n < probes; ++n, i = ( i + 1 ) % slots ) {
+                uintptr_t seen = table[i].load( std::memory_order_acquire );
+                if( seen == uintptr_t( ptr ) ) return table[i].compare_exchange_strong( seen, uintptr_t( erased ) );
+                if( seen == empty ) return false;
+            }
+            return false;
+        }
+        void clear() {
+            for( size_t i = 0; i < slots; ++i ) table[i].store( empty );
+        }
+    };
+
+    struct allocation_tracker {
+        enum { num_shards = 64 };
+        struct record {
+            size_t size;
+            stackid stack;
+            float scale;
+        };
+        struct shard {
+            std::mutex mutex;
+            std::unordered_map< const void *, record > live;
+        } shards[ num_shards ];
+        sampled_set sampled;
+        bool report_at_exit;
+
+        shard &at( const void *ptr ) {
+            uintptr_t h = (uintptr_t)ptr >> 4;
+            return shards[ ( h ^ ( h >> 7 ) ^ ( h >> 13 ) ) % num_shards ];
+        }
+
+        // `caller` is the return address of the hook, ie: the first frame worth keeping. inlining decides how many
+        // of ours come before it, so the stack is cut there rather than after a fixed count
+        void on_alloc( const void *ptr, size_t size, float scale, const void *caller ) {
+            enum { slack = 8 };
+            void *frames[ HEAL_ALLOCATION_DEPTH + slack ];
+            unsigned depth = capture( frames, HEAL_ALLOCATION_DEPTH + slack, 0 ), first = 0;
+            while( first < depth && first < slack && frames[ first ] != caller ) ++first;
+            if( first == depth || frames[ first ] != caller ) first = 0; // not found: keep everything
+            if( depth - first > HEAL_ALLOCATION_DEPTH ) depth = first + HEAL_ALLOCATION_DEPTH;
+            record r = { size, intern( frames + first, depth - first ), scale };
+            shard &s = at( ptr );
+            std::lock_guard<std::mutex> lock( s.mutex );
+            s.live[ ptr ] = r;
+        }
+
+        void on_free( const void *ptr ) {
+            shard &s = at( ptr );
+            std::lock_guard<std::mutex> lock( s.mutex );
+            s.live.erase( ptr );
+        }
+
+        bool take( const void *ptr, record &out ) {
+            shard &s = at( ptr );
+            std::lock_guard<std::mutex> lock( s.mutex );
+            std::unordered_map< const void *, record >::iterator it = s.live.find( ptr );
+            if( it == s.live.end() ) return false;
+            out = it->second;
+            s.live.erase( it );
+            return true;
+        }
+
+        void put( const void *ptr, const record &r ) {
+            shard &s = at( ptr );
+            std::lock_guard<std::mutex> lock( s.mutex );
+            s.live[ ptr ] = r;
+        }
+
+        void clear() {
+            for( unsigned i = 0; i < num_shards; ++i ) {
+                std::lock_guard<std::mutex> lock( shards[i].mutex );
+                shards[i].live.clear();
+            }
+            sampled.clear();
+        }
+    };
+
+    allocation_tracker *new_allocation_tracker() {
+        hook_guard guard;
+        return new allocation_tracker();
+    }
+
+    allocation_tracker &get_allocation_tracker() {
+        static allocation_tracker *tracker = new_allocation_tracker(); // leaked on purpose; frees keep coming until the very end
+        return *tracker;
+    }
+
+    // entry points for the hooks
+    inline void track_alloc( const void *ptr, size_t size, const void *caller ) {
+        if( ptr && tracking_allocations.load( std::memory_order_relaxed ) && !allocation_hook_depth ) {
+            size_t interval = allocation_sample_interval.load( std::memory_order_relaxed );
+            if( interval ) {
+                if( ( bytes_until_sample -= int64_t( size ) ) > 0 ) return;
+                if( !rearm_sampler( interval ) ) return;
+            }
+            hook_guard guard;
+            allocation_tracker &tracker = get_allocation_tracker();
+            if( interval && !tracker.sampled.insert( ptr ) ) return;
+            tracker.on_alloc( ptr, size, sample_scale( size, interval ), caller );
+        }
+    }
+    inline void track_free( const void *ptr ) {
+        if( ptr && tracking_allocations.load( std::memory_order_relaxed ) && !allocation_hook_depth ) {
+            allocation_tracker &tracker = get_allocation_tracker();
+            if( allocation_sample_interval.load( std::memory_order_relaxed ) && !tracker.sampled.erase( ptr ) ) return;
+            hook_guard guard;
+            tracker.on_free( ptr );
+        }
+    }
+
+
+    // realloc() untracks the old block before libc may hand its address out to another thread,
+    // and puts the record back if the call fails and the old block lives on
+    inline bool detach_allocation( const void *ptr, allocation_tracker::record &saved ) {
+        if( !ptr || !tracking_allocations.load( std::memory_order_relaxed ) || allocation_hook_depth ) return false;
+        allocation_tracker &tracker = get_allocation_tracker();
+        if( allocation_sample_interval.load( std::memory_order_relaxed ) && !tracker.sampled.erase( ptr ) ) return false;
+        hook_guard guard;
+        return tracker.take( ptr, saved );
+    }
+    inline void reattach_allocation( const void *ptr, const allocation_tracker::record &saved ) {
+        hook_guard guard;
+        allocation_tracker &tracker = get_allocation_tracker();
+        if( allocation_sample_interval.load( std::memory_order_relaxed ) && !tracker.sampled.insert( ptr ) ) return;
+        tracker.put( ptr, saved );
+    }
+
+#ifdef HEAL_TRACK_ALLOCATIONS
+    void report_allocations_at_exit() {
+        if( !get_allocation_tracker().report_at_exit ) return;
+        tracking_allocations = false;
+        std::string text = allocations::report();
+        fprintf( stderr, "%s", text.c_str() );
+    }
+#endif
+}
+
+bool allocations::start( bool report_at_exit, size_t sample_interval ) {
+#ifdef HEAL_TRACK_ALLOCATIONS
+    allocation_tracker &tracker = get_allocation_tracker();
+    static bool registered = ( std::atexit( report_allocations_at_exit ), true );
+    (void)registered;
+    if( allocation_sample_interval != sample_interval ) {
+        // records of the previous mode cannot be matched against frees anymore
+        tracking_allocations = false;
+        allocation_sample_interval = sample_interval;
+        hook_guard guard;
+        tracker.clear();
+    }
+    tracker.report_at_exit = report_at_exit;
+    tracking_allocations = true;
+    return true;
+#else
+    (void)report_at_exit, (void)sample_interval;
+    return false;
+#endif
+}
+
+void allocations::stop() {
+    tracking_allocations = false;
+}
+
+heap_profile allocations::snapshot() {
+    hook_guard guard;
+    allocation_tracker &tracker = get_allocation_tracker();
+    std::map< stackid, std::pair< double, double > > grouped;
+    for( unsigned i = 0; i < allocation_tracker::num_shards; ++i ) {
+        std::lock_guard<std::mutex> lock( tracker.shards[i].mutex );
+        const std::unordered_map< const void *, allocation_tracker::record > &live = tracker.shards[i].live;
+        for( std::unordered_map< const void *, allocation_tracker::record >::const_iterator it = live.begin(); it != live.end(); ++it ) {
+            std::pair< double, double > &g = grouped[ it->second.stack ];
+            g.first += double( it->second.size ) * it->second.scale;
+            g.second += it->second.scale;
+        }
+    }
+    heap_profile profile;
+    for( std::map< stackid, std::pair< double, double > >::const_iterator it = grouped.begin(); it != grouped.end(); ++it ) {
+        heap_profile::site s = { it->first, int64_t( it->second.first + 0.5 ), int64_t( it->second.second + 0.5 ) };
+        profile.sites.push_back( s );
+        profile.bytes += s.bytes, profile.count += s.count;
+    }
+    std::sort( profile.sites.begin(), profile.sites.end(), []( const heap_profile::site &a, const heap_profile::site &b ) { return a.bytes > b.bytes; } );
+    return profile;
+}
+
+std::string allocations::report( size_t top ) {
+    return snapshot().str( top );
+}
+
+heap_profile heap_profile::operator-( const heap_profile &before ) const {
+    std::map< stackid, site > grouped;
+    for( size_t i = 0; i < sites.size(); ++i ) grouped[ sites[i].stack ] = sites[i];
+    for( size_t i = 0; i < before.sites.size(); ++i ) {
+        site &s = grouped[ before.sites[i].stack ];
+        s.stack = before.sites[i].stack;
+        s.bytes -= before.sites[i].bytes, s.count -= before.sites[i].count;
+    }
+    heap_profile diff;
+    for( std::map< stackid, site >::const_iterator it = grouped.begin(); it != grouped.end(); ++it ) {
+        if( !it->second.bytes && !it->second.count ) continue;
+        diff.sites.push_back( it->second );
+    }
+    std::sort( diff.sites.begin(), diff.sites.end(), []( const site &a, const site &b ) { return a.bytes > b.bytes; } );
+    diff.bytes = bytes - before.bytes, diff.count = count - before.count;
+    return diff;
+}
+
+std::string heap_profile::str( size_t top ) const {
+    hook_guard guard; // symbolizer caches filled while reporting are not leaks
+    std::string out = heal::sfstring( "\1 bytes in \2 allocations, \3 callstacks\n", bytes, count, uint64_t( sites.size() ) );
+    for( size_t i = 0; i < sites.size() && ( !top || i < top ); ++i ) {
+        out += heal::sfstring( "\n\1 bytes in \2 allocations from:\n", sites[i].bytes, sites[i].count );
+        out += sites[i].stack.size() ? sites[i].stack.flat( "    #\1 \2\n" ) : std::string( "    (no frames)\n" );
+    }
+    return out;
+}
+
+// CRASH HANDLER
+// Fatal signals are reported from a preallocated alternate stack, using async-signal-safe calls only:
+// no malloc, no stdio, no locks. The report (signal, fault address, registers, raw frames) goes straight
+// to a preopened fd through a small fixed-buffer writer. Symbolization, which does allocate, runs in a
+// forked child under an alarm, so a corrupted heap or a held lock can only cost the symbolized part.
+// Then the previous disposition is restored and the signal re-raised, so core dumps and chained
+// handlers keep working.
+//
+// With set_crash_file() the handler also writes a compact crash file with a single writev(): registers
+// and raw frames of every thread (the others are signaled with HEAL_THREAD_SIGNAL and fill preallocated
+// slots), the top of each stack, the module list with build-ids and the crash_annotate() area.
+// crash_report() and heal-crashdump.cc decode and symbolize it offline. Layout, native endianness:
+//   crash_file_header
+//   crash_module_record x num_modules
+//   crash_thread_record x num_threads
+//   uint64_t frames[max_frames] x num_threads
+//   stack copies of every thread, back to back (crash_thread_record::stack_bytes each)
+//   annotations, "key=value\n" lines
+
+#ifndef HEAL_CRASH_STACK_SIZE
+#define HEAL_CRASH_STACK_SIZE (64 * 1024)
+#endif
+
+#ifndef HEAL_CRASH_MAX_FRAMES
+#define HEAL_CRASH_MAX_FRAMES 128
+#endif
+
+#ifndef HEAL_CRASH_SYMBOLIZE_SECONDS
+#define HEAL_CRASH_SYMBOLIZE_SECONDS 10
+#endif
+
+#ifndef HEAL_CRASH_MAX_THREADS
+#define HEAL_CRASH_MAX_THREADS 256
+#endif
+
+#ifndef HEAL_CRASH_MAX_MODULES
+#define HEAL_CRASH_MAX_MODULES 512
+#endif
+
+#ifndef HEAL_CRASH_ANNOTATION_SIZE
+#define HEAL_CRASH_ANNOTATION_SIZE 4096
+#endif
+
+#ifndef HEAL_CRASH_THREAD_TIMEOUT_MS
+#define HEAL_CRASH_THREAD_TIMEOUT_MS 500
+#endif
+
+#ifndef HEAL_THREAD_SIGNAL
+#define HEAL_THREAD_SIGNAL (SIGRTMIN + 3)  // asks a thread to snapshot its own context
+#endif
+
+namespace {
+
+    enum { crash_file_version = 1, crash_arch_x86_64 = 1, crash_arch_aarch64 = 2, crash_max_regs = 34 };
+
+    struct crash_file_header {
+        char magic[8];                      // "HEALCRSH"
+        uint32_t version, arch;
+        int32_t signal, code;
+        uint64_t fault_address, time;       // time: seconds since epoch
+        uint32_t pid, crashed_tid;
+        uint32_t num_threads, num_modules;
+        uint32_t max_frames, annotation_bytes;
+    };
+
+    struct crash_module_record {
+        uint64_t bias, lo, hi;
+        uint32_t build_id_len, path_len;
+        unsigned char build_id[32];
+        char path[256];
+    };
+
+    struct crash_thread_record {
+        uint32_t tid, num_frames, num_regs, stack_bytes;
+        uint64_t sp;
+        char name[16];
+        uint64_t regs[ crash_max_regs ];
+    };
+
+    const char *crash_register_name( uint32_t arch, unsigned i ) {
+        static const char *x86_64[] = {
+            "rip", "rsp", "rbp", "rax", "rbx", "rcx", "rdx", "rsi", "rdi",
+            "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15", "eflags"
+        };
+        static const char *aarch64[] = {
+            "x0", "x1", "x2", "x3", "x4", "x5", "x6", "x7", "x8", "x9", "x10", "x11", "x12", "x13", "x14", "x15", "x16",
+            "x17", "x18", "x19", "x20", "x21", "x22", "x23", "x24", "x25", "x26", "x27", "x28", "x29", "x30", "sp", "pc", "pstate"
+        };
+        if( arch == crash_arch_x86_64 ) return i < sizeof(x86_64) / sizeof(x86_64[0]) ? x86_64[i] : "?";
+        if( arch == crash_arch_aarch64 ) return i < sizeof(aarch64) / sizeof(aarch64[0]) ? aarch64[i] : "?";
+        return "?";
+    }
+
+    // linux numbering; crash files are only written there
+    const char *crash_signal_name( int sig ) {
+        switch( sig ) {
+            case 11: return "SIGSEGV";
+            case 7: return "SIGBUS";
+            case 8: return "SIGFPE";
+            case 4: return "SIGILL";
+            case 6: return "SIGABRT";
+            default: return "signal";
+        }
+    }
+
+    // published "key=value\n" text. double buffered, so the crash handler reads it without locking.
+    struct crash_annotations {
+        std::mutex mutex;
+        std::map< std::string, std::string > values;
+        char area[2][ HEAL_CRASH_ANNOTATION_SIZE ];
+        unsigned length[2];
+        std::atomic<unsigned> current;
+
+        const char *text( unsigned &len ) const {
+            unsigned i = current.load( std::memory_order_acquire );
+            return len = length[i], area[i];
+        }
+    };
+    std::atomic< crash_annotations * > annotations( 0 );
+}
+
+bool crash_annotate( const std::string &key, const std::string &value ) {
+    static std::mutex mutex;
+    crash_annotations *a;
+    {
+        std::lock_guard<std::mutex> lock( mutex );
+        if( !( a = annotations.load() ) ) annotations = a = new crash_annotations(); // leaked on purpose
+    }
+    std::lock_guard<std::mutex> lock( a->mutex );
+    std::map< std::string, std::string > values = a->values;
+    if( value.empty() ) values.erase( key ); else values[ key ] = value;
+    std::string text;
+    for( std::map< std::string, std::string >::const_iterator it = values.begin(); it != values.end(); ++it )
+        text += it->first + "=" + it->second + "\n";
+    if( text.size() > HEAL_CRASH_ANNOTATION_SIZE ) return false;
+    unsigned next = a->current.load() ^ 1;
+    std::memcpy( a->area[ next ], text.data(), text.size() );
+    a->length[ next ] = unsigned( text.size() );
+    a->current.store( next, std::memory_order_release );
+    a->values.swap( values );
+    return true;
+}
+
+#if $on($unwinder)
+
+namespace {
+
+    const int crash_signals[] = { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT };
+    enum { num_crash_signals = sizeof(crash_signals) / sizeof(crash_signals[0]) };
+
+    #if defined(__x86_64__)
+    const uint32_t crash_arch = crash_arch_x86_64;
+    #else
+    const uint32_t crash_arch = crash_arch_aarch64;
+    #endif
+
+    // registers of an interrupted context, in crash_register_name() order. returns count.
+    unsigned context_registers( const void *context, uint64_t *out ) {
+        const ucontext_t *uc = (const ucontext_t *)context;
+        #if defined(__x86_64__)
+        static const int regs[] = {
+            REG_RIP, REG_RSP, REG_RBP, REG_RAX, REG_RBX, REG_RCX, REG_RDX, REG_RSI, REG_RDI,
+            REG_R8, REG_R9, REG_R10, REG_R11, REG_R12, REG_R13, REG_R14, REG_R15, REG_EFL
+        };
+        for( unsigned i = 0; i < sizeof(regs) / sizeof(regs[0]); ++i ) out[i] = uint64_t( uc->uc_mcontext.gregs[ regs[i] ] );
+        return sizeof(regs) / sizeof(regs[0]);
+        #else
+        for( unsigned i = 0; i < 31; ++i ) out[i] = uc->uc_mcontext.regs[i];
+        out[31] = uc->uc_mcontext.sp, out[32] = uc->uc_mcontext.pc, out[33] = uc->uc_mcontext.pstate;
+        return 34;
+        #endif
+    }
+    inline uint64_t context_sp( const uint64_t *regs ) {
+        return regs[ crash_arch == crash_arch_x86_64 ? 1 : 31 ];
+    }
+
+    // threads answering HEAL_THREAD_SIGNAL fill the slot matching their tid, then raise its ready flag
+    struct thread_snapshot {
+        crash_thread_record *records;
+        uint64_t *frames;                   // max_frames per record
+        std::atomic<int> *ready;
+        unsigned count, max_frames;
+    };
+    std::atomic< thread_snapshot * > active_snapshot( 0 );
+    std::atomic<int> snapshot_handlers( 0 ); // handlers that may still touch active_snapshot
+
+    void fill_thread_record( crash_thread_record &r, uint64_t *frames, unsigned max_frames, const void *context ) {
+        void *raw[ HEAL_CRASH_MAX_FRAMES ];
+        r.num_regs = context_registers( context, r.regs );
+        r.sp = context_sp( r.regs );
+        r.num_frames = capture_context( context, raw, max_frames < HEAL_CRASH_MAX_FRAMES ? max_frames : HEAL_CRASH_MAX_FRAMES );
+        for( unsigned i = 0; i < r.num_frames; ++i ) frames[i] = uint64_t( uintptr_t( raw[i] ) );
+    }
+
+    void on_thread_signal( int, siginfo_t *, void *context ) {
+        int saved_errno = errno;
+        snapshot_handlers.fetch_add( 1 );
+        thread_snapshot *s = active_snapshot.load();
+        uint32_t tid = uint32_t( syscall( SYS_gettid ) );
+        for( unsigned i = 0; s && i < s->count; ++i ) {
+            if( s->records[i].tid != tid || s->ready[i].load( std::memory_order_relaxed ) ) continue;
+            fill_thread_record( s->records[i], s->frames + i * s->max_frames, s->max_frames, context );
+            s->ready[i].store( 1, std::memory_order_release );
+            break;
+        }
+        snapshot_handlers.fetch_sub( 1 );
+        errno = saved_errno;
+    }
+
+    bool install_thread_signal() {
+        static std::atomic<bool> installed( false );
+        if( installed ) return true;
+        struct sigaction sa;
+        std::memset( &sa, 0, sizeof(sa) );
+        sa.sa_sigaction = on_thread_signal;
+        sa.sa_flags = SA_SIGINFO | SA_RESTART;
+        sigemptyset( &sa.sa_mask );
+        return installed = sigaction( HEAL_THREAD_SIGNAL, &sa, 0 ) == 0;
+    }
+
+    uint64_t monotonic_ms() {
+        struct timespec ts;
+        clock_gettime( CLOCK_MONOTONIC, &ts );
+        return uint64_t( ts.tv_sec ) * 1000 + uint64_t( ts.tv_nsec ) / 1000000;
+    }
+
+    // tids of this process, from /proc/self/task. async-signal-safe.
+    unsigned list_threads( uint32_t *tids, unsigned capacity ) {
+        struct dirent64_raw {
+            uint64_t d_ino;
+            int64_t d_off;
+            unsigned short d_reclen;
+            unsigned char d_type;
+            char d_name[1];
+        };
+        int fd = open( "/proc/self/task", O_RDONLY | O_DIRECTORY | O_CLOEXEC );
+        if( fd < 0 ) return 0;
+        unsigned n = 0;
+        char buf[ 2048 ];
+        for( long len; n < capacity && ( len = syscall( SYS_getdents64, fd, buf, sizeof(buf) ) ) > 0; ) {
+            for( long off = 0; off < len; ) {
+                const dirent64_raw *d = (const dirent64_raw *)( buf + off );
+                uint32_t tid = 0;
+                for( const char *p = d->d_name; *p >= '0' && *p <= '9'; ++p ) tid = tid * 10 + uint32_t( *p - '0' );
+                if( tid && n < capacity ) tids[ n++ ] = tid;
+                off += d->d_reclen;
+            }
+        }
+        close( fd );
+        return n;
+    }
 
-            void * const * frames = &this->frames[ from ];
-            const std::string invalid = "????";
+    // "/proc/self/task/<tid>/comm" into name[16]. async-signal-safe.
+    void read_thread_name( uint32_t tid, char *name ) {
+        char path[64] = "/proc/self/task/", digits[12];
+        unsigned len = 16, n = 0;
+        do digits[ n++ ] = char( '0' + tid % 10 ); while( tid /= 10 );
+        while( n ) path[ len++ ] = digits[ --n ];
+        std::memcpy( path + len, "/comm", 6 );
+        int fd = open( path, O_RDONLY | O_CLOEXEC );
+        ssize_t got = fd < 0 ? 0 : read( fd, name, 15 );
+        if( fd >= 0 ) close( fd );
+        name[ got > 0 ? got : 0 ] = '\0';
+        for( char *p = name; *p; ++p ) if( *p == '\n' ) *p = '\0';
+    }
 
-            $windows({
-                SymSetOptions(SYMOPT_UNDNAME);
+    struct crash_state {
+        std::atomic<bool> installed;
+        std::atomic<pid_t> owner; // thread writing a report
+        int fd;
+        bool symbolize;
+        struct sigaction previous[ num_crash_signals ];
+
+        // crash file. the arena is mmap'ed by set_crash_file(), and never released.
+        std::atomic<bool> file_enabled;
+        char path[ 1024 ], executable[ 256 ];
+        unsigned stack_bytes, num_modules;
+        crash_module_record *modules;
+        crash_thread_record *records;
+        uint64_t *frames;
+        std::atomic<int> *ready;
+        unsigned char *stacks;
+    };
 
-                $no(
-                    // polite version. this is how things should be done.
-                    HANDLE process = GetCurrentProcess();
-                    if( SymInitialize( process, NULL, TRUE ) )
-                )
-                $yes(
-                    // this is what we have to do because other memory managers are not polite enough. fuck them off
-                    static HANDLE process = GetCurrentProcess();
-                    static int init = SymInitialize( process, NULL, TRUE );
-                    if( !init )
-                        fail( "<heal/heal.cpp> says: cannot initialize Dbghelp.lib" );
-                )
-                {
-                    enum { MAXSYMBOLNAME = 512 - sizeof(IMAGEHLP_SYMBOL64) };
-                    char symbol64_buf     [ 512 ];
-                    char symbol64_bufblank[ 512 ] = {0};
-                    IMAGEHLP_SYMBOL64 *symbol64       = reinterpret_cast<IMAGEHLP_SYMBOL64*>(symbol64_buf);
-                    IMAGEHLP_SYMBOL64 *symbol64_blank = reinterpret_cast<IMAGEHLP_SYMBOL64*>(symbol64_bufblank);
-                    symbol64_blank->SizeOfStruct = sizeof(IMAGEHLP_SYMBOL64);
-                    symbol64_blank->MaxNameLength = (MAXSYMBOLNAME-1) / 2; //wchar?
+    crash_state &get_crash_state() {
+        static crash_state state; // zero initialized, no constructor runs at crash time
+        return state;
+    }
 
-                    IMAGEHLP_LINE64 line64, line64_blank = {0};
-                    line64_blank.SizeOfStruct = sizeof(IMAGEHLP_LINE64);
+    int collect_crash_module( struct dl_phdr_info *info, size_t, void *data ) {
+        crash_state &cs = *(crash_state *)data;
+        if( cs.num_modules >= HEAL_CRASH_MAX_MODULES ) return 1;
+        crash_module_record &m = cs.modules[ cs.num_modules ];
+        const char *name = info->dlpi_name && info->dlpi_name[0] ? info->dlpi_name : cs.executable;
+        for( m.path_len = 0; name[ m.path_len ] && m.path_len < sizeof(m.path) - 1; ++m.path_len ) m.path[ m.path_len ] = name[ m.path_len ];
+        m.path[ m.path_len ] = '\0';
+        m.bias = info->dlpi_addr, m.lo = ~uint64_t(0), m.hi = 0, m.build_id_len = 0;
+        for( int i = 0; i < info->dlpi_phnum; ++i ) {
+            const ElfW(Phdr) &ph = info->dlpi_phdr[i];
+            if( ph.p_type == PT_NOTE && !m.build_id_len ) {
+                const unsigned char *note = (const unsigned char *)( m.bias + ph.p_vaddr ), *end = note + ph.p_memsz;
+                while( note + 12 <= end ) {
+                    uint32_t namesz, descsz, type;
+                    std::memcpy( &namesz, note, 4 ), std::memcpy( &descsz, note + 4, 4 ), std::memcpy( &type, note + 8, 4 );
+                    const unsigned char *desc = note + 12 + ( ( namesz + 3 ) & ~3u );
+                    if( desc + descsz > end ) break;
+                    if( type == NT_GNU_BUILD_ID && namesz == 4 && !std::memcmp( note + 12, "GNU", 4 ) && descsz <= sizeof(m.build_id) ) {
+                        std::memcpy( m.build_id, desc, descsz );
+                        m.build_id_len = descsz;
+                        break;
+                    }
+                    note = desc + ( ( descsz + 3 ) & ~3u );
+                }
+            }
+            if( ph.p_type != PT_LOAD ) continue;
+            uint64_t lo = m.bias + ph.p_vaddr, hi = lo + ph.p_memsz;
+            if( lo < m.lo ) m.lo = lo;
+            if( hi > m.hi ) m.hi = hi;
+        }
+        if( m.lo < m.hi ) cs.num_modules++;
+        return 0;
+    }
 
-                    for( unsigned i = 0; i < num_frames; i++ ) {
-                        *symbol64 = *symbol64_blank;
-                        DWORD64 displacement64 = 0;
+    // stops every other thread in its signal handler long enough to grab its context, then writes the file
+    void write_crash_file( crash_state &cs, int sig, const siginfo_t *info, const void *context ) {
+        const uint32_t pid = uint32_t( getpid() ), self = uint32_t( syscall( SYS_gettid ) );
+        uint32_t tids[ HEAL_CRASH_MAX_THREADS ];
+        unsigned found = list_threads( tids, HEAL_CRASH_MAX_THREADS ), count = 1;
+
+        std::memset( &cs.records[0], 0, sizeof(crash_thread_record) );
+        cs.records[0].tid = self;
+        for( unsigned i = 0; i < found && count < HEAL_CRASH_MAX_THREADS; ++i ) { // slot 0 is ours, listed or not
+            if( tids[i] == self ) continue;
+            std::memset( &cs.records[ count ], 0, sizeof(crash_thread_record) );
+            cs.records[ count ].tid = tids[i];
+            cs.ready[ count++ ].store( 0 );
+        }
 
-                        if( SymGetSymFromAddr64( process, (DWORD64) frames[i], &displacement64, symbol64 ) ) {
-                            line64 = line64_blank;
-                            DWORD displacement = 0;
-                            if( SymGetLineFromAddr64( process, (DWORD64) frames[i], &displacement, &line64 ) ) {
-                                backtraces[i] = heal::sfstring( "\1 (\2:\3)", symbol64->Name, line64.FileName, line64.LineNumber );
-                            } else {
-                                backtraces[i] = symbol64->Name;
-                            }
-                        } else  backtraces[i] = invalid;
-                    }
+        thread_snapshot snapshot = { cs.records, cs.frames, cs.ready, count, HEAL_CRASH_MAX_FRAMES };
+        fill_thread_record( cs.records[0], cs.frames, HEAL_CRASH_MAX_FRAMES, context );
+        cs.ready[0].store( 1 );
+        active_snapshot.store( &snapshot, std::memory_order_release );
+        for( unsigned i = 1; i < count; ++i ) syscall( SYS_tgkill, pid, cs.records[i].tid, HEAL_THREAD_SIGNAL );
+        for( uint64_t deadline = monotonic_ms() + HEAL_CRASH_THREAD_TIMEOUT_MS; monotonic_ms() < deadline; ) {
+            unsigned pending = 0;
+            for( unsigned i = 1; i < count; ++i ) pending += !cs.ready[i].load( std::memory_order_acquire );
+            if( !pending ) break;
+            struct timespec ts = { 0, 1000000 };
+            nanosleep( &ts, 0 );
+        }
+        active_snapshot.store( 0 );
+        // late answers must not outlive `snapshot` nor race the write below. bounded too: a handler may be the one that crashed
+        for( uint64_t deadline = monotonic_ms() + HEAL_CRASH_THREAD_TIMEOUT_MS; snapshot_handlers.load() && monotonic_ms() < deadline; ) {
+            struct timespec ts = { 0, 1000000 };
+            nanosleep( &ts, 0 );
+        }
+        for( unsigned i = 1; i < count; ++i )
+            if( !cs.ready[i].load( std::memory_order_acquire ) ) cs.records[i].num_regs = 0, cs.records[i].num_frames = 0;
+
+        // names and stack copies. process_vm_readv() fails softly on unmapped memory
+        struct iovec iov[ 5 + HEAL_CRASH_MAX_THREADS ];
+        unsigned num_iov = 4;
+        for( unsigned i = 0; i < count; ++i ) {
+            crash_thread_record &r = cs.records[i];
+            read_thread_name( r.tid, r.name );
+            if( !r.num_regs || !cs.stack_bytes ) continue;
+            struct iovec local = { cs.stacks + size_t( i ) * cs.stack_bytes, cs.stack_bytes };
+            struct iovec remote = { (void *)uintptr_t( r.sp ), cs.stack_bytes };
+            ssize_t got = process_vm_readv( pid_t( pid ), &local, 1, &remote, 1, 0 );
+            r.stack_bytes = got > 0 ? uint32_t( got ) : 0;
+            if( r.stack_bytes ) iov[ num_iov ].iov_base = local.iov_base, iov[ num_iov++ ].iov_len = r.stack_bytes;
+        }
 
-                    $no(
-                        // fuck the others. cleanup commented.
-                        SymCleanup(process);
-                    )
-                }
-                DWORD error = GetLastError();
+        cs.num_modules = 0;
+        dl_iterate_phdr( &collect_crash_module, &cs );
+
+        unsigned annotation_bytes = 0;
+        const char *annotation_text = annotations.load() ? annotations.load()->text( annotation_bytes ) : "";
+
+        crash_file_header h;
+        std::memset( &h, 0, sizeof(h) );
+        std::memcpy( h.magic, "HEALCRSH", 8 );
+        h.version = crash_file_version, h.arch = crash_arch;
+        h.signal = sig, h.code = info->si_code, h.fault_address = uint64_t( uintptr_t( info->si_addr ) );
+        struct timespec now;
+        clock_gettime( CLOCK_REALTIME, &now );
+        h.time = uint64_t( now.tv_sec );
+        h.pid = pid, h.crashed_tid = self;
+        h.num_threads = count, h.num_modules = cs.num_modules;
+        h.max_frames = HEAL_CRASH_MAX_FRAMES, h.annotation_bytes = annotation_bytes;
+
+        iov[0].iov_base = &h, iov[0].iov_len = sizeof(h);
+        iov[1].iov_base = cs.modules, iov[1].iov_len = sizeof(crash_module_record) * cs.num_modules;
+        iov[2].iov_base = cs.records, iov[2].iov_len = sizeof(crash_thread_record) * count;
+        iov[3].iov_base = cs.frames, iov[3].iov_len = sizeof(uint64_t) * HEAL_CRASH_MAX_FRAMES * count;
+        iov[ num_iov ].iov_base = (void *)annotation_text, iov[ num_iov++ ].iov_len = annotation_bytes;
+
+        int fd = open( cs.path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600 );
+        if( fd < 0 ) return;
+        // one writev; only loops on the (unlikely) short write
+        for( struct iovec *v = iov, *end = iov + num_iov; v < end; ) {
+            ssize_t n = writev( fd, v, int( end - v ) );
+            if( n < 0 && errno == EINTR ) continue;
+            if( n <= 0 ) break;
+            for( ; v < end && size_t( n ) >= v->iov_len; ++v ) n -= ssize_t( v->iov_len );
+            if( v < end ) v->iov_base = (char *)v->iov_base + n, v->iov_len -= size_t( n );
+        }
+        close( fd );
+    }
 
-                return backtraces;
-            })
-            $gnuc({
-                char **strings = backtrace_symbols(frames, num_frames);
+    void on_crash( int sig, siginfo_t *info, void *context ) {
+        crash_state &cs = get_crash_state();
+        pid_t tid = pid_t( syscall( SYS_gettid ) ), none = 0;
+        int slot = 0;
+        while( slot < num_crash_signals && crash_signals[ slot ] != sig ) ++slot;
+
+        // one report at a time. a crash inside the report itself just falls through to the previous handler.
+        if( cs.owner.compare_exchange_strong( none, tid ) ) {
+            int saved_errno = errno;
+            sigsafe_writer w( cs.fd );
+            w.str( "heal: crash: " ).str( crash_signal_name( sig ) ).str( " (signal " ).dec( sig ).str( ", code " ).dec( info->si_code );
+            w.str( "), fault address " ).ptr( info->si_addr ).str( ", pid " ).dec( getpid() ).str( ", tid " ).dec( tid ).str( "\n" );
+            uint64_t regs[ crash_max_regs ];
+            for( unsigned i = 0, n = context_registers( context, regs ); i < n; ++i ) {
+                w.str( i % 6 ? " " : "  " ).str( crash_register_name( crash_arch, i ) ).str( "=" ).hex( regs[i] );
+                if( i % 6 == 5 || i + 1 == n ) w.str( "\n" );
+            }
+            unsigned annotation_bytes = 0;
+            const char *annotation_text = annotations.load() ? annotations.load()->text( annotation_bytes ) : "";
+            if( annotation_bytes ) w.str( "annotations:\n" );
+            for( unsigned i = 0; i < annotation_bytes; ++i ) {
+                if( !i || annotation_text[ i - 1 ] == '\n' ) w.str( "  " );
+                w.chr( annotation_text[i] );
+            }
+            w.flush(); // keep what we have, should unwinding fault
+
+            void *frames[ HEAL_CRASH_MAX_FRAMES ];
+            unsigned n = capture_context( context, frames, HEAL_CRASH_MAX_FRAMES );
+            w.str( "frames:" );
+            for( unsigned i = 0; i < n; ++i ) w.chr( ' ' ).ptr( frames[i] );
+            w.str( "\n" );
+            w.flush();
+
+            if( cs.file_enabled ) {
+                write_crash_file( cs, sig, info, context );
+                w.str( "crash file: " ).str( cs.path ).str( "\n" );
+                w.flush();
+            }
 
-                // Decode the strings
-                if( strings ) {
-                    for( unsigned i = 0; i < num_frames; i++ ) {
-                        backtraces[i] = ( strings[i] ? demangle(strings[i]) : invalid );
+            if( cs.symbolize && n ) {
+                // raw clone: fork() runs atfork handlers and takes malloc locks a crashed thread may hold
+                pid_t child = pid_t( syscall( SYS_clone, SIGCHLD, 0, 0, 0, 0 ) );
+                if( child == 0 ) {
+                    alarm( HEAL_CRASH_SYMBOLIZE_SECONDS ); // symbolizer may allocate and lock; do not hang on a broken heap
+                    std::vector<std::string> lines = format_stack( frames, n, "  #\1 \2\n" );
+                    sigsafe_writer out( cs.fd );
+                    for( size_t i = 0; i < lines.size(); ++i ) out.str( lines[i].data(), lines[i].size() );
+                    out.flush();
+                    _exit( 0 );
+                }
+                if( child > 0 ) {
+                    // the child's alarm() is not enough if it is stopped or ignores SIGALRM
+                    int status;
+                    uint64_t deadline = monotonic_ms() + ( HEAL_CRASH_SYMBOLIZE_SECONDS + 1 ) * 1000ull;
+                    for(;;) {
+                        pid_t r = waitpid( child, &status, WNOHANG );
+                        if( r == child || ( r < 0 && errno != EINTR ) ) break;
+                        if( monotonic_ms() >= deadline ) {
+                            kill( child, SIGKILL );
+                            while( waitpid( child, &status, 0 ) < 0 && errno == EINTR ) {}
+                            break;
+                        }
+                        struct timespec ts = { 0, 1000000 };
+                        nanosleep( &ts, 0 );
                     }
-                    free( strings );
                 }
+            }
+            errno = saved_errno;
+        }
+        else if( cs.owner.load() != tid ) {
+            for(;;) pause(); // another thread is reporting, and will take the process down
+        }
 
-                return backtraces;
-            })
+        // fall through to the previous disposition: faults re-execute and raise again, sent signals are re-raised
+        sigaction( sig, &cs.previous[ slot < num_crash_signals ? slot : 0 ], 0 );
+        if( info->si_code <= 0 || sig == SIGABRT ) raise( sig );
+    }
 
-            return backtraces;
+    // one alternate stack per thread, mmap'ed once and never released
+    $tls( bool crash_stack_ready ) = false;
+
+    bool prepare_crash_stack() {
+        if( crash_stack_ready ) return true;
+        void *stack = mmap( 0, HEAL_CRASH_STACK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+        if( stack == MAP_FAILED ) return false;
+        stack_t ss;
+        ss.ss_sp = stack;
+        ss.ss_size = HEAL_CRASH_STACK_SIZE;
+        ss.ss_flags = 0;
+        if( sigaltstack( &ss, 0 ) != 0 ) {
+            munmap( stack, HEAL_CRASH_STACK_SIZE );
+            return false;
         }
+        current_stack_bounds(); // the handler never computes them itself
+        return crash_stack_ready = true;
+    }
+}
 
-        std::vector<std::string> callstack::str( const char *format12, size_t skip_begin ) const {
-            callstack copy = *this;
-            std::vector<std::string> stacktrace = copy.unwind( skip_begin );
-
-            for( size_t i = 0, end = stacktrace.size(); i < end; i++ )
-                stacktrace[i] = heal::sfstring( format12, i + 1, stacktrace[i] );
+#endif
 
-            return stacktrace;
+bool install_crash_handler( int fd, bool symbolize ) {
+    (void)fd, (void)symbolize;
+    $unwinder({
+        crash_state &cs = get_crash_state();
+        cs.fd = fd;
+        cs.symbolize = symbolize;
+        if( !prepare_crash_stack() ) return false;
+        sync_modules();
+        if( cs.installed.exchange( true ) ) return true;
+        for( int i = 0; i < num_crash_signals; ++i ) {
+            struct sigaction sa;
+            std::memset( &sa, 0, sizeof(sa) );
+            sa.sa_sigaction = on_crash;
+            sa.sa_flags = SA_SIGINFO | SA_ONSTACK;
+            sigemptyset( &sa.sa_mask );
+            sigaction( crash_signals[i], &sa, &cs.previous[i] );
         }
+        return true;
+    })
+    return false;
+}
 
-        std::string callstack::flat( const char *format12, size_t skip_begin ) const {
-            std::vector<std::string> vec = str( format12, skip_begin );
-            std::string str;
-            for( std::vector<std::string>::const_iterator it = vec.begin(), end = vec.end(); it != end; ++it ) {
-                str += *it;
-            }
-            return str;
+bool set_crash_file( const std::string &path, unsigned stack_kb ) {
+    (void)path, (void)stack_kb;
+    $unwinder({
+        static std::mutex mutex;
+        std::lock_guard<std::mutex> lock( mutex );
+        crash_state &cs = get_crash_state();
+        if( path.empty() ) return cs.file_enabled = false, true;
+        if( path.size() >= sizeof(cs.path) ) return false;
+
+        unsigned stack_bytes = stack_kb * 1024;
+        if( !cs.records || stack_bytes > cs.stack_bytes ) {
+            size_t size = sizeof(crash_module_record) * HEAL_CRASH_MAX_MODULES
+                + ( sizeof(crash_thread_record) + sizeof(uint64_t) * HEAL_CRASH_MAX_FRAMES + sizeof(std::atomic<int>) + stack_bytes ) * HEAL_CRASH_MAX_THREADS;
+            void *arena = mmap( 0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+            if( arena == MAP_FAILED ) return false;
+            cs.file_enabled = false; // older arena stays mapped, a crash may be using it right now
+            unsigned char *p = (unsigned char *)arena;
+            cs.modules = (crash_module_record *)p, p += sizeof(crash_module_record) * HEAL_CRASH_MAX_MODULES;
+            cs.records = (crash_thread_record *)p, p += sizeof(crash_thread_record) * HEAL_CRASH_MAX_THREADS;
+            cs.frames = (uint64_t *)p, p += sizeof(uint64_t) * HEAL_CRASH_MAX_FRAMES * HEAL_CRASH_MAX_THREADS;
+            cs.ready = (std::atomic<int> *)p, p += sizeof(std::atomic<int>) * HEAL_CRASH_MAX_THREADS;
+            cs.stacks = p;
         }
+        cs.stack_bytes = stack_bytes;
+        std::memcpy( cs.path, path.c_str(), path.size() + 1 );
+        std::string exe = symbolizer::executable();
+        std::strncpy( cs.executable, exe.c_str(), sizeof(cs.executable) - 1 );
 
-std::vector<std::string> stacktrace( const char *format12, size_t skip_initial ) {
-    return callstack(true).str( format12, skip_initial );
+        if( !install_thread_signal() ) return false;
+        cs.file_enabled = true;
+        return true;
+    })
+    return false;
 }
 
-std::string stackstring( const char *format12, size_t skip_initial ) {
-    std::string out;
-    std::vector<std::string> stack = stacktrace( format12, skip_initial );
-    for( std::vector<std::string>::const_iterator it = stack.begin(), end = stack.end(); it != end; ++it ) {
-        out += *it;
+std::string crash_report( std::istream &is, const char *format12, bool with_stacks ) {
+    crash_file_header h;
+    if( !is.read( (char *)&h, sizeof(h) ) || std::memcmp( h.magic, "HEALCRSH", 8 ) )
+        return "not a heal crash file\n";
+    if( h.version != crash_file_version )
+        return heal::sfstring( "unsupported crash file version \1\n", h.version );
+
+    std::vector< crash_module_record > modules( h.num_modules );
+    std::vector< crash_thread_record > threads( h.num_threads );
+    std::vector< uint64_t > frames( size_t( h.num_threads ) * h.max_frames );
+    std::vector< std::string > stacks( h.num_threads );
+    std::string annotation_text( h.annotation_bytes, '\0' );
+    if( h.num_modules ) is.read( (char *)&modules[0], sizeof(crash_module_record) * modules.size() );
+    if( h.num_threads ) is.read( (char *)&threads[0], sizeof(crash_thread_record) * threads.size() );
+    if( !frames.empty() ) is.read( (char *)&frames[0], sizeof(uint64_t) * frames.size() );
+    for( size_t i = 0; i < threads.size(); ++i ) {
+        stacks[i].resize( threads[i].stack_bytes );
+        if( threads[i].stack_bytes ) is.read( &stacks[i][0], threads[i].stack_bytes );
+    }
+    if( h.annotation_bytes ) is.read( &annotation_text[0], h.annotation_bytes );
+    if( !is ) return "truncated crash file\n";
+
+    char buf[128];
+    sprintf( buf, "), fault address 0x%" PRIx64 ", pid %" PRIu32 ", time %" PRIu64 "\n", h.fault_address, h.pid, h.time );
+    std::string out = heal::sfstring( "crash: \1 (signal \2, code \3", crash_signal_name( h.signal ), h.signal, h.code ) + buf;
+    if( !annotation_text.empty() ) {
+        std::stringstream ss( annotation_text );
+        out += "annotations:\n";
+        for( std::string line; std::getline( ss, line ); ) out += "  " + line + "\n";
+    }
+
+    // reuse the offline symbolizer: every thread becomes a module snapshot plus one stack dump
+    static const char hex[] = "0123456789abcdef";
+    std::string snapshot = "heal-modules 1\n";
+    for( size_t i = 0; i < modules.size(); ++i ) {
+        const crash_module_record &m = modules[i];
+        std::string build_id = m.build_id_len ? std::string() : std::string( "-" );
+        for( uint32_t b = 0; b < m.build_id_len && b < sizeof(m.build_id); ++b ) build_id += hex[ m.build_id[b] >> 4 ], build_id += hex[ m.build_id[b] & 15 ];
+        sprintf( buf, "m %" PRIx64 " %" PRIx64 " %" PRIx64 " ", m.bias, m.lo, m.hi );
+        snapshot += buf + build_id + " " + std::string( m.path, (std::min)( size_t( m.path_len ), sizeof(m.path) - 1 ) ) + "\n";
+    }
+
+    for( size_t t = 0; t < threads.size(); ++t ) {
+        const crash_thread_record &r = threads[t];
+        std::string name( r.name, strnlen( r.name, sizeof(r.name) ) );
+        out += heal::sfstring( "\nthread \1 \"\2\"", r.tid, name ) + ( r.tid == h.crashed_tid ? " (crashed)\n" : "\n" );
+        if( !r.num_regs ) {
+            out += "  (no answer)\n";
+            continue;
+        }
+        for( unsigned i = 0; i < r.num_regs && i < crash_max_regs; ++i ) {
+            sprintf( buf, "%s%s=0x%" PRIx64 "%s", i % 6 ? " " : "  ", crash_register_name( h.arch, i ), r.regs[i], i % 6 == 5 || i + 1 == r.num_regs ? "\n" : "" );
+            out += buf;
+        }
+        std::vector< void * > raw;
+        for( uint32_t i = 0; i < r.num_frames && i < h.max_frames; ++i ) raw.push_back( (void *)uintptr_t( frames[ t * h.max_frames + i ] ) );
+        std::stringstream dump( snapshot + dump_stack( raw.empty() ? 0 : &raw[0], raw.size() ) );
+        std::string symbolized = symbolize_dump( dump, format12 );
+        if( t ) { // build-id warnings once is enough
+            std::stringstream ss( symbolized );
+            symbolized.clear();
+            for( std::string line; std::getline( ss, line ); ) if( line.compare( 0, 9, "# warning" ) ) symbolized += line + "\n";
+        }
+        out += symbolized;
+        if( with_stacks && !stacks[t].empty() ) {
+            out += heal::sfstring( "  stack, \1 bytes from sp:\n", r.stack_bytes );
+            out += hexdump( stacks[t].data(), stacks[t].size(), (const void *)uintptr_t( r.sp ) );
+        }
     }
     return out;
 }
 
+// ALL STACKS
+// Callstacks of every thread, without attaching a debugger. Each thread listed in /proc/self/task gets
+// HEAL_THREAD_SIGNAL and unwinds its own interrupted context into a slot allocated beforehand by the
+// caller (see thread_snapshot above), which then symbolizes nothing: it just collects frames.
+// Names are read before signaling: a thread may exit right after answering. The signal cuts short plain
+// usleep()/nanosleep() calls (EINTR) of the interrupted threads.
+
+std::map< std::string, callstack > all_stacks( unsigned timeout_ms ) {
+    std::map< std::string, callstack > stacks;
+    callstack self;
+    self.save();
+    $unwinder({
+        static std::mutex mutex;
+        std::lock_guard<std::mutex> lock( mutex );
+        if( !install_thread_signal() ) return stacks;
+        current_stack_bounds();
+
+        std::vector< uint32_t > tids( HEAL_CRASH_MAX_THREADS );
+        tids.resize( list_threads( &tids[0], HEAL_CRASH_MAX_THREADS ) );
+        const uint32_t pid = uint32_t( getpid() ), me = uint32_t( syscall( SYS_gettid ) );
+        const unsigned max_frames = HEAL_MAX_TRACES < HEAL_CRASH_MAX_FRAMES ? HEAL_MAX_TRACES : HEAL_CRASH_MAX_FRAMES;
+
+        std::vector< crash_thread_record > records( tids.size() + 1 );
+        std::vector< uint64_t > frames( records.size() * max_frames );
+        std::vector< std::atomic<int> > ready( records.size() );
+        unsigned count = 0;
+        for( size_t i = 0; i < tids.size(); ++i ) {
+            if( tids[i] == me ) continue;
+            std::memset( &records[ count ], 0, sizeof(crash_thread_record) );
+            records[ count ].tid = tids[i];
+            read_thread_name( tids[i], records[ count ].name );
+            ready[ count++ ].store( 0 );
+        }
+
+        thread_snapshot snapshot = { &records[0], &frames[0], &ready[0], count, max_frames };
+        active_snapshot.store( &snapshot );
+        for( unsigned i = 0; i < count; ++i )
+            if( syscall( SYS_tgkill, pid, records[i].tid, HEAL_THREAD_SIGNAL ) != 0 ) ready[i].store( -1 ); // gone already
+        for( uint64_t deadline = monotonic_ms() + timeout_ms;; ) {
+            unsigned pending = 0;
+            for( unsigned i = 0; i < count; ++i ) pending += !ready[i].load( std::memory_order_acquire );
+            if( !pending || monotonic_ms() >= deadline ) break;
+            std::this_thread::yield();
+        }
+        active_snapshot.store( 0 );
+        while( snapshot_handlers.load() ) std::this_thread::yield(); // late answers must not outlive the slots
+
+        for( unsigned i = 0; i < count; ++i ) {
+            if( ready[i].load() < 0 ) continue;
+            callstack cs;
+            for( uint32_t f = 0; ready[i].load() > 0 && f < records[i].num_frames; ++f )
+                cs.frames.push_back( (void *)uintptr_t( frames[ i * max_frames + f ] ) );
+            stacks[ heal::sfstring( "\1 \2", records[i].tid, records[i].name ) ] = cs;
+        }
+        char name[16];
+        read_thread_name( me, name );
+        stacks[ heal::sfstring( "\1 \2", me, name ) ] = self;
+        return stacks;
+    })
+    stacks[ "self" ] = self;
+    return stacks;
+}
+
 // DIE
 
 void die( const std::string &reason, int errorcode )
@@ -912,6 +4996,7 @@ void die( const std::string &reason, int errorcode )
     if( !reason.empty() ) {
         fail( reason );
     }
+    flush_workers();
 
     $windows(
     FatalExit( errorcode );
@@ -927,114 +5012,444 @@ void die( int errorcode, const std::string &reason )
 }
 
 // HEXDUMP
-// @todo: maxwidth != 80 doesnt work
-
-std::string hexdump( const void *data, size_t num_bytes, const void *self )
-{
-#   ifdef _MSC_VER
-#       pragma warning( push )
-#       pragma warning( disable : 4996 )
-#       define $vsnprintf _vsnprintf
-#   else
-#       define $vsnprintf  vsnprintf
-#   endif
+// Rows are rendered with two lookup tables (byte -> 2 hex digits, byte -> printable char) into a 64 KiB chunk,
+// which is handed to the sink whenever it fills up. Nothing is formatted per byte and nothing is allocated
+// per row, so big buffers stream at memory speed rather than at printf speed. Dumps bigger than a slice are
+// split in slices rendered on a few threads, and files are mmap'ed rather than read.
 
-    struct local {
-        static std::string format( const char *fmt, ... )
-        {
-            int len;
-            std::string self;
+#ifndef HEAL_HEXDUMP_SLICE
+#define HEAL_HEXDUMP_SLICE (256 << 10)      // bytes of input per rendering task. its text is ~9x bigger
+#endif
 
-            using namespace std;
+#ifndef HEAL_HEXDUMP_THREADS
+#define HEAL_HEXDUMP_THREADS 8              // renderers at most, each holding one slice of text
+#endif
 
-            // Calculate the final length of the formatted string
-            {
-                va_list args;
-                va_start( args, fmt );
-                len = $vsnprintf( 0, 0, fmt, args );
-                va_end( args );
+namespace {
+    // 3 chars per byte ("4f ", " O "), padded to 4 so each one is a single store
+    struct hexdump_tables {
+        char hex[ 256 ][ 4 ], asc[ 256 ][ 4 ];
+
+        hexdump_tables() {
+            for( unsigned b = 0; b < 256; ++b ) {
+                hex[b][0] = "0123456789abcdef"[ b >> 4 ], hex[b][1] = "0123456789abcdef"[ b & 15 ], hex[b][2] = hex[b][3] = ' ';
+                asc[b][0] = asc[b][2] = asc[b][3] = ' ', asc[b][1] = b < 32 || b >= 127 ? '.' : char( b );
             }
+        }
+    };
 
-            // Allocate a buffer (including room for null termination
-            char* target_string = new char[++len];
+    // fixed width, so rows line up
+    char *write_address( char *out, uintptr_t addr ) {
+        for( int shift = int( sizeof(addr) * 8 ) - 4; shift >= 0; shift -= 4 ) *out++ = "0123456789ABCDEF"[ ( addr >> shift ) & 15 ];
+        return out;
+    }
 
-            // Generate the formatted string
-            {
-                va_list args;
-                va_start( args, fmt );
-                $vsnprintf( target_string, len, fmt, args );
-                va_end( args );
-            }
+    void ostream_sink( const char *text, size_t size, void *user ) {
+        ( (std::ostream *)user )->write( text, std::streamsize( size ) );
+    }
+
+    void fd_sink( const char *text, size_t size, void *user ) {
+        int fd = int( (intptr_t)user );
+        while( size ) {
+            $windows( int n = _write( fd, text, unsigned( size ) ); )
+            $welse( ssize_t n = ::write( fd, text, size ); )
+            if( n < 0 && errno == EINTR ) continue;
+            if( n <= 0 ) break;
+            text += n, size -= size_t( n );
+        }
+    }
+
+    void string_sink( const char *text, size_t size, void *user ) {
+        ( (std::string *)user )->append( text, size );
+    }
+
+    size_t hexdump_size( size_t num_bytes, const hexdump_options &options ) {
+        size_t width = (std::max)( 1u, (std::min)( options.width, 256u ) ), rows = ( num_bytes + width - 1 ) / width;
+        if( options.max_rows && rows > options.max_rows ) rows = options.max_rows;
+        return 128 + width * 3 + rows * 2 * ( sizeof(void *) * 2 + 1 + width * 3 + 4 ) + 64;
+    }
+}
 
-            // Assign the formatted string
-            self.assign( target_string );
+namespace {
+    struct hexdump_job {
+        const unsigned char *p;
+        size_t num_bytes, dumped;
+        uintptr_t base;
+        unsigned width;
+        bool skip_repeated;
+
+        // whole row, same bytes as the whole row above
+        bool repeated( size_t i ) const {
+            return skip_repeated && i >= width && i + width <= num_bytes && !std::memcmp( p + i, p + i - width, width );
+        }
 
-            // Clean up
-            delete [] target_string;
+        // rows starting in [begin, end). a row only looks at itself and the two rows above, so slices of the
+        // same dump can be rendered independently and concatenated
+        void render( size_t begin, size_t end, hexdump_sink sink, void *user ) const {
+            static const hexdump_tables tables;
+            char chunk[ 64 * 1024 ], *out = chunk;
+            const size_t row_size = 2 * ( sizeof(void *) * 2 + 1 + width * 3 + 4 );
+
+            for( size_t i = begin; i < end; i += width ) {
+                if( size_t( chunk + sizeof(chunk) - out ) < row_size + 1 ) { // +1: table stores write one byte ahead
+                    sink( chunk, size_t( out - chunk ), user );
+                    out = chunk;
+                }
+                if( repeated( i ) ) {
+                    if( !repeated( i - width ) ) *out++ = '*', *out++ = '\n';
+                    continue;
+                }
+                const size_t avail = (std::min)( size_t( width ), num_bytes - i );
+                const unsigned char *row = p + i;
+
+                char *address = out;
+                out = write_address( out, base + i );
+                *out++ = ' ';
+                for( size_t c = 0; c < avail; ++c, out += 3 ) std::memcpy( out, tables.asc[ row[c] ], 4 );
+                for( size_t c = avail; c < width; ++c ) out[0] = ' ', out[1] = '.', out[2] = ' ', out += 3;
+                out = (char *)std::memcpy( out, "asc\n", 4 ) + 4;
+
+                out = (char *)std::memcpy( out, address, sizeof(void *) * 2 + 1 ) + sizeof(void *) * 2 + 1;
+                for( size_t c = 0; c < avail; ++c, out += 3 ) std::memcpy( out, tables.hex[ row[c] ], 4 );
+                for( size_t c = avail; c < width; ++c ) out[0] = '?', out[1] = '?', out[2] = ' ', out += 3;
+                out = (char *)std::memcpy( out, "hex\n", 4 ) + 4;
+            }
+            if( out > chunk ) sink( chunk, size_t( out - chunk ), user );
+        }
 
-            return self;
+        // big dumps: worker k renders slices k, k + threads, ... into buffer k, one at a time, while the caller
+        // hands the buffers to the sink in order. at most `threads` slices of text are alive at once
+        void render_parallel( unsigned threads, hexdump_sink sink, void *user ) const {
+            const size_t slice = ( (std::max)( HEAL_HEXDUMP_SLICE / width, 1u ) ) * width, slices = ( dumped + slice - 1 ) / slice;
+            threads = unsigned( (std::min)( size_t( threads ), slices ) );
+            struct buffer { std::string text; bool full; };
+            std::vector<buffer> buffers( threads );
+            std::mutex mutex;
+            std::condition_variable rendered, consumed;
+
+            std::vector<std::thread> pool;
+            for( unsigned k = 0; k < threads; ++k ) pool.push_back( std::thread( [&, k] {
+                for( size_t s = k; s < slices; s += threads ) {
+                    {
+                        std::unique_lock<std::mutex> lock( mutex );
+                        consumed.wait( lock, [&] { return !buffers[k].full; } );
+                    }
+                    buffers[k].text.clear();
+                    render( s * slice, (std::min)( s * slice + slice, dumped ), string_sink, &buffers[k].text );
+                    std::lock_guard<std::mutex> lock( mutex );
+                    buffers[k].full = true;
+                    rendered.notify_all();
+                }
+            } ) );
+            for( size_t s = 0; s < slices; ++s ) {
+                buffer &b = buffers[ s % threads ];
+                {
+                    std::unique_lock<std::mutex> lock( mutex );
+                    rendered.wait( lock, [&] { return b.full; } );
+                }
+                if( !b.text.empty() ) sink( b.text.data(), b.text.size(), user );
+                std::lock_guard<std::mutex> lock( mutex );
+                b.full = false;
+                consumed.notify_all();
+            }
+            for( unsigned k = 0; k < threads; ++k ) pool[k].join();
         }
     };
 
-    unsigned maxwidth = 80;
-    unsigned width = 16; //column width
-    unsigned width_offset_block = (8 + 1);
-    unsigned width_chars_block  = (width * 3 + 1) + sizeof("asc");
-    unsigned width_hex_block    = (width * 3 + 1) + sizeof("hex");
-    unsigned width_padding = (std::max)( 0, int( maxwidth - ( width_offset_block + width_chars_block + width_hex_block ) ) );
-    unsigned blocks = width_padding / ( width_chars_block + width_hex_block ) ;
+    size_t hexdump_range( hexdump_sink sink, void *user, const void *data, size_t num_bytes, uintptr_t base, const hexdump_options &options ) {
+        hexdump_job job;
+        job.p = (const unsigned char *)data;
+        job.num_bytes = job.p ? num_bytes : 0;
+        job.base = base;
+        job.width = (std::max)( 1u, (std::min)( options.width, 256u ) );
+        job.skip_repeated = options.skip_repeated;
+        job.dumped = job.num_bytes;
+        if( options.max_rows && job.dumped / job.width >= options.max_rows ) job.dumped = options.max_rows * job.width;
+
+        // header: column labels, then where and how much
+        char header[ 1024 ], *out = header;
+        out = (char *)std::memcpy( out, "offset", 6 ) + 6;
+        while( out < header + sizeof(void *) * 2 + 1 ) *out++ = ' ';
+        for( unsigned c = 0; c < job.width; ++c ) {
+            *out++ = "0123456789ABCDEF"[ ( c >> 4 ) & 15 ], *out++ = "0123456789ABCDEF"[ c & 15 ], *out++ = ' ';
+        }
+        out += snprintf( out, 64, "[ptr=0x%" PRIxPTR " sz=%" PRIu64 "]\n", base, uint64_t( job.num_bytes ) );
+        sink( header, size_t( out - header ), user );
+
+        unsigned threads = options.threads ? options.threads : (std::min)( std::thread::hardware_concurrency(), unsigned( HEAL_HEXDUMP_THREADS ) );
+        if( threads > 1 && job.dumped > HEAL_HEXDUMP_SLICE ) job.render_parallel( threads, sink, user );
+        else job.render( 0, job.dumped, sink, user );
+
+        // a dump ending in "*" gets the end address on a line of its own, like hexdump -C
+        if( job.dumped && job.repeated( ( job.dumped - 1 ) / job.width * job.width ) ) {
+            out = write_address( header, base + job.dumped );
+            *out++ = '\n';
+            sink( header, size_t( out - header ), user );
+        }
+
+        if( job.dumped < job.num_bytes ) {
+            size_t len = sfformat_to( header, sizeof(header), "... \1 more bytes\n", uint64_t( job.num_bytes - job.dumped ) );
+            sink( header, len, user );
+        }
+        return job.dumped;
+    }
+}
 
-    unsigned dumpsize = ( num_bytes < width * 16 ? num_bytes : width * 16 ); //16 lines max
+size_t hexdump_to( hexdump_sink sink, void *user, const void *data, size_t num_bytes, const hexdump_options &options ) {
+    return hexdump_range( sink, user, data, num_bytes, uintptr_t( options.self ? options.self : data ), options );
+}
 
-    std::string result;
+size_t hexdump_to( std::ostream &os, const void *data, size_t num_bytes, const hexdump_options &options ) {
+    return hexdump_to( ostream_sink, &os, data, num_bytes, options );
+}
 
-    result += local::format( "%-*s %-.*s [ptr=%p sz=%d]\n", width_offset_block - 1, "offset", width_chars_block - 1, "00 01 02 03 04 05 06 07 08 09 0A 0B 0C 0D 0E 0F", self ? self : data, num_bytes );
+size_t hexdump_to( int fd, const void *data, size_t num_bytes, const hexdump_options &options ) {
+    return hexdump_to( fd_sink, (void *)intptr_t( fd ), data, num_bytes, options );
+}
 
-    if( !num_bytes )
-        return result;
+std::string hexdump( const void *data, size_t num_bytes, const hexdump_options &options ) {
+    std::string out;
+    out.reserve( hexdump_size( num_bytes, options ) );
+    hexdump_to( string_sink, &out, data, num_bytes, options );
+    return out;
+}
 
-    blocks++;
+std::string hexdump( const void *data, size_t num_bytes, const void *self ) {
+    return hexdump( data, num_bytes, hexdump_options( 16, 0, self ) );
+}
 
-    const unsigned char *p = reinterpret_cast<const unsigned char *>( data );
-    size_t i = 0;
+bool hexdump_fd( hexdump_sink sink, void *user, int fd, uint64_t offset, uint64_t length, const hexdump_options &options ) {
+    $windows( return false; )
+    $welse(
+        struct stat st;
+        if( fstat( fd, &st ) != 0 || !S_ISREG( st.st_mode ) ) return false;
+        uint64_t size = uint64_t( st.st_size );
+        if( offset > size ) offset = size;
+        if( length > size - offset ) length = size - offset;
+        if( length > uint64_t( ~size_t(0) ) ) length = ~size_t(0);
+        uintptr_t base = uintptr_t( offset ) + uintptr_t( options.self );
+        if( !length ) return hexdump_range( sink, user, 0, 0, base, options ), true;
+
+        // map from the page that holds `offset`
+        uint64_t lead = offset % uint64_t( sysconf( _SC_PAGESIZE ) );
+        void *map = mmap( 0, size_t( length + lead ), PROT_READ, MAP_PRIVATE, fd, off_t( offset - lead ) );
+        if( map == MAP_FAILED ) return false;
+        madvise( map, size_t( length + lead ), MADV_SEQUENTIAL );
+        hexdump_range( sink, user, (const char *)map + lead, size_t( length ), base, options );
+        munmap( map, size_t( length + lead ) );
+        return true;
+    )
+}
 
-    while( i < dumpsize )
-    {
-        //offset block
-        result += local::format("%p ", (size_t)(p + i) ); //%08x, %08zx
+bool hexdump_file( hexdump_sink sink, void *user, const std::string &path, uint64_t offset, uint64_t length, const hexdump_options &options ) {
+    $windows( return false; )
+    $welse(
+        int fd = open( path.c_str(), O_RDONLY | O_CLOEXEC );
+        if( fd < 0 ) return false;
+        bool ok = hexdump_fd( sink, user, fd, offset, length, options );
+        close( fd );
+        return ok;
+    )
+}
 
-        //chars blocks
-        for( unsigned b = 0; b < blocks; b++)
-        {
-            for( unsigned c = 0 ; c < width ; c++ )
-                result += local::format(" %c ", i + c >= dumpsize ? '.' : p[i + c] < 32 || p[i + c] >= 127 ? '.' : p[i + c]);
+bool hexdump_file( std::ostream &os, const std::string &path, uint64_t offset, uint64_t length, const hexdump_options &options ) {
+    return hexdump_file( ostream_sink, &os, path, offset, length, options );
+}
+
+// HEXDIFF
+// mismatch() skips equal bytes 64 or 128 at a time: AVX2 when the cpu has it (picked at runtime on gcc/clang),
+// SSE2 on any x86-64, 8-byte words elsewhere. Identical stretches are only ever read once, by that loop,
+// so diffing mostly equal buffers runs at about memory bandwidth. Rendering only touches the rows shown.
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__)
+#   define HEAL_HEXDIFF_SSE2 1
+#endif
+#if defined(HEAL_HEXDIFF_SSE2) && ( defined(__x86_64__) || defined(__i386__) ) && defined(__GNUC__)
+#   define HEAL_HEXDIFF_AVX2 1 // needs the intrinsics headers and the SSE2 tail; both come with SSE2 only
+#endif
 
-            result += "asc\n";
+namespace {
+    unsigned lowest_bit( unsigned mask ) {
+        $msvc( unsigned long index; _BitScanForward( &index, mask ); return unsigned( index ); )
+        $gnuc( return unsigned( __builtin_ctz( mask ) ); )
+        unsigned index = 0;
+        while( !( mask & 1 ) ) mask >>= 1, ++index;
+        return index;
+    }
+
+    size_t mismatch_scalar( const unsigned char *a, const unsigned char *b, size_t n, size_t i ) {
+        for( ; i + 8 <= n; i += 8 ) {
+            uint64_t x, y;
+            std::memcpy( &x, a + i, 8 ), std::memcpy( &y, b + i, 8 );
+            if( x != y ) break;
+        }
+        while( i < n && a[i] == b[i] ) ++i;
+        return i;
+    }
+
+#ifdef HEAL_HEXDIFF_SSE2
+    size_t mismatch_sse2( const unsigned char *a, const unsigned char *b, size_t n, size_t i ) {
+        #define $heal_eq16(k) _mm_cmpeq_epi8( _mm_loadu_si128( (const __m128i *)( a + i + k ) ), _mm_loadu_si128( (const __m128i *)( b + i + k ) ) )
+        for( ; i + 64 <= n; i += 64 ) {
+            __m128i eq = _mm_and_si128( _mm_and_si128( $heal_eq16(0), $heal_eq16(16) ), _mm_and_si128( $heal_eq16(32), $heal_eq16(48) ) );
+            if( _mm_movemask_epi8( eq ) != 0xFFFF ) break;
+        }
+        for( ; i + 16 <= n; i += 16 ) {
+            unsigned mask = unsigned( _mm_movemask_epi8( $heal_eq16(0) ) ) ^ 0xFFFFu;
+            if( mask ) return i + lowest_bit( mask );
+        }
+        #undef $heal_eq16
+        return mismatch_scalar( a, b, n, i );
+    }
+#endif
+
+#ifdef HEAL_HEXDIFF_AVX2
+    __attribute__((target("avx2")))
+    size_t mismatch_avx2( const unsigned char *a, const unsigned char *b, size_t n, size_t i ) {
+        #define $heal_eq32(k) _mm256_cmpeq_epi8( _mm256_loadu_si256( (const __m256i *)( a + i + k ) ), _mm256_loadu_si256( (const __m256i *)( b + i + k ) ) )
+        for( ; i + 128 <= n; i += 128 ) {
+            __m256i eq = _mm256_and_si256( _mm256_and_si256( $heal_eq32(0), $heal_eq32(32) ), _mm256_and_si256( $heal_eq32(64), $heal_eq32(96) ) );
+            if( unsigned( _mm256_movemask_epi8( eq ) ) != 0xFFFFFFFFu ) break;
+        }
+        for( ; i + 32 <= n; i += 32 ) {
+            unsigned mask = ~unsigned( _mm256_movemask_epi8( $heal_eq32(0) ) );
+            if( mask ) return i + lowest_bit( mask );
         }
+        #undef $heal_eq32
+        return mismatch_sse2( a, b, n, i );
+    }
+#endif
 
-        //offset block
-        result += local::format("%p ", (size_t)(p + i) ); //%08x, %08zx
+    typedef size_t (*mismatch_fn)( const unsigned char *, const unsigned char *, size_t, size_t );
 
-        //hex blocks
-        for( unsigned b = 0; b < blocks; b++)
-        {
-            for( unsigned c = 0; c < width ; c++)
-                result += local::format( i + c < dumpsize ? "%02x " : "?? ", p[i + c]);
+    mismatch_fn pick_mismatch() {
+#ifdef HEAL_HEXDIFF_AVX2
+        __builtin_cpu_init();
+        if( __builtin_cpu_supports( "avx2" ) ) return mismatch_avx2;
+#endif
+#ifdef HEAL_HEXDIFF_SSE2
+        return mismatch_sse2;
+#endif
+        return mismatch_scalar;
+    }
+
+    struct hexdiff_job {
+        const unsigned char *a, *b;
+        size_t num_bytes;
+        unsigned width;
+        bool color;
+        hexdump_sink sink;
+        void *user;
+        char chunk[ 64 * 1024 ], *out;
+
+        void reserve() {
+            if( size_t( chunk + sizeof(chunk) - out ) < 16 * 1024 ) flush(); // 3 lines of 256 colored bytes fit
+        }
+        void flush() {
+            if( out > chunk ) sink( chunk, size_t( out - chunk ), user );
+            out = chunk;
+        }
+        void text( const char *s, size_t n ) {
+            out = (char *)std::memcpy( out, s, n ) + n;
+        }
+
+        // one line of row `r` from buffer `p`: offset, hex bytes, tag. `other` highlights bytes that differ from it
+        void line( size_t r, const unsigned char *p, const unsigned char *other, const char *tag ) {
+            static const hexdump_tables tables;
+            size_t begin = r * width, avail = (std::min)( size_t( width ), num_bytes - begin );
+            out = write_address( out, uintptr_t( begin ) );
+            *out++ = ' ';
+            for( size_t c = 0; c < avail; ++c ) {
+                bool changed = color && other && p[ begin + c ] != other[ begin + c ];
+                if( changed ) text( p == a ? "\x1b[1;31m" : "\x1b[1;32m", 7 );
+                std::memcpy( out, tables.hex[ p[ begin + c ] ], 4 ), out += 2;
+                if( changed ) text( "\x1b[0m", 4 );
+                *out++ = ' ';
+            }
+            for( size_t c = avail; c < width; ++c ) text( "?? ", 3 );
+            text( tag, strlen( tag ) );
+            *out++ = '\n';
+        }
 
-            result += "hex\n";
+        void marker( size_t r ) {
+            size_t begin = r * width, avail = (std::min)( size_t( width ), num_bytes - begin ), last = 0;
+            char *start = out;
+            for( size_t i = 0; i < sizeof(void *) * 2 + 1; ++i ) *out++ = ' ';
+            for( size_t c = 0; c < avail; ++c ) {
+                bool changed = a[ begin + c ] != b[ begin + c ];
+                text( changed ? "^^ " : "   ", 3 );
+                if( changed ) last = size_t( out - start ) - 1;
+            }
+            out = start + last;
+            *out++ = '\n';
         }
+    };
+}
 
-        //next line
-        //result += '\n';
-        i += width * blocks;
+size_t mismatch( const void *a, const void *b, size_t num_bytes, size_t from ) {
+    static const mismatch_fn fn = pick_mismatch();
+    return from >= num_bytes ? num_bytes : fn( (const unsigned char *)a, (const unsigned char *)b, num_bytes, from );
+}
+
+size_t hexdiff_to( hexdump_sink sink, void *user, const void *a, const void *b, size_t num_bytes, const hexdiff_options &options ) {
+    hexdiff_job job;
+    job.a = (const unsigned char *)a, job.b = (const unsigned char *)b;
+    job.num_bytes = a && b ? num_bytes : 0;
+    job.width = (std::max)( 1u, (std::min)( options.width, 256u ) );
+    job.color = options.color;
+    job.sink = sink, job.user = user, job.out = job.chunk;
+
+    // header: column labels, then what and how much
+    job.text( "offset", 6 );
+    while( job.out < job.chunk + sizeof(void *) * 2 + 1 ) *job.out++ = ' ';
+    for( unsigned c = 0; c < job.width; ++c ) {
+        *job.out++ = "0123456789ABCDEF"[ ( c >> 4 ) & 15 ], *job.out++ = "0123456789ABCDEF"[ c & 15 ], *job.out++ = ' ';
+    }
+    job.out += snprintf( job.out, 96, "[a=0x%" PRIxPTR " b=0x%" PRIxPTR " sz=%" PRIu64 "]\n", uintptr_t( a ), uintptr_t( b ), uint64_t( num_bytes ) );
+
+    const size_t rows = ( job.num_bytes + job.width - 1 ) / job.width, context = options.context;
+    size_t shown = 0, diff_rows = 0, diff_bytes = 0, last = 0;  // shown: first row not printed yet. last: last differing row + 1
+    bool quiet = false;
+    for( size_t pos = mismatch( a, b, job.num_bytes ); pos < job.num_bytes; pos = mismatch( a, b, job.num_bytes, last * job.width ) ) {
+        size_t row = pos / job.width, begin = row * job.width, end = (std::min)( begin + job.width, job.num_bytes ), changed = 0;
+        for( size_t i = pos; i < end; ++i ) changed += job.a[i] != job.b[i];
+        diff_bytes += changed, ++diff_rows;
+        bool was_quiet = quiet;
+        quiet = quiet || ( options.max_rows && diff_rows > options.max_rows );
+        if( !was_quiet && diff_rows > 1 ) {
+            // rest of the previous row's context, even if this row is past max_rows
+            for( ; shown < row && shown < last + context; ++shown ) job.reserve(), job.line( shown, job.a, 0, "=" );
+        }
+        if( !quiet ) {
+            // a gap, then the leading context of this row
+            size_t lead = row > context ? row - context : 0;
+            if( lead > shown ) job.reserve(), job.text( "...\n", 4 ), shown = lead;
+            for( ; shown < row; ++shown ) job.reserve(), job.line( shown, job.a, 0, "=" );
+            job.reserve();
+            job.line( row, job.a, job.b, "a" );
+            job.line( row, job.b, job.a, "b" );
+            if( !job.color ) job.marker( row );
+            shown = row + 1;
+        }
+        last = row + 1;
     }
+    if( !quiet ) for( ; shown < rows && shown < last + context && diff_rows; ++shown ) job.reserve(), job.line( shown, job.a, 0, "=" );
 
-    return result;
+    job.reserve();
+    if( diff_rows && quiet ) job.out += sfformat_to( job.out, 128, "... \1 more differing rows\n", uint64_t( diff_rows - options.max_rows ) );
+    job.out += sfformat_to( job.out, 128, "\1 bytes differ in \2 rows\n", uint64_t( diff_bytes ), uint64_t( diff_rows ) );
+    job.flush();
+    return diff_bytes;
+}
 
-#   undef $vsnprintf
-#   ifdef _MSC_VER
-#       pragma warning( pop )
-#   endif
+size_t hexdiff_to( std::ostream &os, const void *a, const void *b, size_t num_bytes, const hexdiff_options &options ) {
+    return hexdiff_to( ostream_sink, &os, a, b, num_bytes, options );
+}
+
+std::string hexdiff( const void *a, const void *b, size_t num_bytes, const hexdiff_options &options ) {
+    std::string out;
+    hexdiff_to( string_sink, &out, a, b, num_bytes, options );
+    return out;
 }
 
 std::string timestamp() {
@@ -1381,6 +5796,129 @@ std::string prompt( const std::string &current_value, const std::string &title,
 #   pragma warning( pop )
 #endif
 
+// ALLOCATION HOOKS
+// global operator new/delete replacements, plus malloc family interposition on glibc. see ALLOCATIONS above.
+
+#ifdef HEAL_TRACK_ALLOCATIONS
+
+#include <new>
+
+#if $on($msvc)
+#   include <intrin.h>
+#   define $heal_caller _ReturnAddress()
+#else
+#   define $heal_caller __builtin_return_address(0)
+#endif
+
+#if defined(__GLIBC__)
+
+extern "C" {
+    void *__libc_malloc( size_t );
+    void *__libc_calloc( size_t, size_t );
+    void *__libc_realloc( void *, size_t );
+    void *__libc_memalign( size_t, size_t );
+    void *__libc_valloc( size_t );
+    void *__libc_pvalloc( size_t );
+    void  __libc_free( void * );
+
+    void *malloc( size_t size ) {
+        void *ptr = __libc_malloc( size );
+        heal::track_alloc( ptr, size, $heal_caller );
+        return ptr;
+    }
+    void *calloc( size_t num, size_t size ) {
+        void *ptr = __libc_calloc( num, size );
+        heal::track_alloc( ptr, num * size, $heal_caller );
+        return ptr;
+    }
+    void *memalign( size_t alignment, size_t size ) {
+        void *ptr = __libc_memalign( alignment, size );
+        heal::track_alloc( ptr, size, $heal_caller );
+        return ptr;
+    }
+    void *aligned_alloc( size_t alignment, size_t size ) {
+        if( !alignment || ( alignment & ( alignment - 1 ) ) ) return errno = EINVAL, (void *)0;
+        void *ptr = __libc_memalign( alignment, size );
+        heal::track_alloc( ptr, size, $heal_caller );
+        return ptr;
+    }
+    int posix_memalign( void **out, size_t alignment, size_t size ) {
+        if( !alignment || ( alignment & ( alignment - 1 ) ) || alignment % sizeof(void *) ) return EINVAL;
+        int saved_errno = errno;
+        void *ptr = __libc_memalign( alignment, size );
+        errno = saved_errno; // posix_memalign() reports through its result only
+        if( !ptr ) return ENOMEM;
+        heal::track_alloc( ptr, size, $heal_caller );
+        return *out = ptr, 0;
+    }
+    void *valloc( size_t size ) {
+        void *ptr = __libc_valloc( size );
+        heal::track_alloc( ptr, size, $heal_caller );
+        return ptr;
+    }
+    void *pvalloc( size_t size ) {
+        void *ptr = __libc_pvalloc( size );
+        heal::track_alloc( ptr, size, $heal_caller );
+        return ptr;
+    }
+    void *realloc( void *old, size_t size ) {
+        heal::allocation_tracker::record saved;
+        bool detached = heal::detach_allocation( old, saved );
+        void *ptr = __libc_realloc( old, size );
+        if( !ptr && size && detached ) heal::reattach_allocation( old, saved ); // failed: the old block is still there
+        heal::track_alloc( ptr, size, $heal_caller );
+        return ptr;
+    }
+    void free( void *ptr ) {
+        heal::track_free( ptr );
+        __libc_free( ptr );
+    }
+}
+
+#   define $heal_malloc(size) __libc_malloc(size)
+#   define $heal_free(ptr)    __libc_free(ptr)
+#else
+#   define $heal_malloc(size) std::malloc(size)
+#   define $heal_free(ptr)    std::free(ptr)
+#endif
+
+namespace {
+    void *tracked_new( size_t size, bool nothrow, const void *caller ) {
+        void *ptr;
+        while( !(ptr = $heal_malloc( size ? size : 1 )) ) {
+            std::new_handler handler = std::get_new_handler();
+            if( handler ) handler();
+            else if( nothrow ) return 0;
+            else $throw( throw std::bad_alloc(); ) $telse( std::abort(); )
+        }
+        heal::track_alloc( ptr, size, caller );
+        return ptr;
+    }
+    void tracked_delete( void *ptr ) {
+        heal::track_free( ptr );
+        $heal_free( ptr );
+    }
+}
+
+void *operator new( size_t size ) { return tracked_new( size, false, $heal_caller ); }
+void *operator new[]( size_t size ) { return tracked_new( size, false, $heal_caller ); }
+void *operator new( size_t size, const std::nothrow_t & ) throw() { return tracked_new( size, true, $heal_caller ); }
+void *operator new[]( size_t size, const std::nothrow_t & ) throw() { return tracked_new( size, true, $heal_caller ); }
+void operator delete( void *ptr ) throw() { tracked_delete( ptr ); }
+void operator delete[]( void *ptr ) throw() { tracked_delete( ptr ); }
+void operator delete( void *ptr, const std::nothrow_t & ) throw() { tracked_delete( ptr ); }
+void operator delete[]( void *ptr, const std::nothrow_t & ) throw() { tracked_delete( ptr ); }
+#if __cplusplus >= 201402L
+void operator delete( void *ptr, size_t ) throw() { tracked_delete( ptr ); }
+void operator delete[]( void *ptr, size_t ) throw() { tracked_delete( ptr ); }
+#endif
+
+#undef $heal_malloc
+#undef $heal_free
+#undef $heal_caller
+
+#endif
+
 /*
 #undef $debug
 #undef $release
@@ -1397,3 +5935,28 @@ std::string prompt( const std::string &current_value, const std::string &title,
 #undef $yes
 */
 
+// LOADER HOOKS
+// dlopen() and dlclose() wrappers that keep the module table and generation current. see SYMBOLIZER above.
+// they only interpose when heal is part of the executable or of a library loaded at startup.
+
+#if $on($linux) && defined(__GLIBC__)
+
+extern "C" {
+    void *dlopen( const char *file, int mode ) throw() {
+        typedef void *(*next_fn)( const char *, int );
+        static next_fn next = (next_fn)dlsym( RTLD_NEXT, "dlopen" );
+        void *handle = next ? next( file, mode ) : 0;
+        if( handle ) heal::rebuild_modules();
+        return handle;
+    }
+    int dlclose( void *handle ) throw() {
+        typedef int (*next_fn)( void * );
+        static next_fn next = (next_fn)dlsym( RTLD_NEXT, "dlclose" );
+        heal::modules_unloading( true );
+        int result = next ? next( handle ) : -1;
+        heal::modules_unloading( false );
+        return result;
+    }
+}
+
+#endif
@@ -209,7 +209,11 @@ namespace std {
 #include <inttypes.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
 
+#include <atomic>
+#include <chrono>
 #include <iostream>
 #include <istream>
 #include <map>
@@ -226,13 +230,230 @@ namespace heal {
 
     typedef std::function< int( const std::string &in ) > heal_callback_in;
 
-    extern std::vector< heal_callback_in > warns;
-    extern std::vector< heal_callback_in > fails;
+    // chain of callbacks. dispatch() runs them from the latest backwards until one returns true, over an immutable
+    // snapshot: lock-free. writers copy, edit and publish a new snapshot. readers register in striped counters
+    // for the current epoch; writes retire the old snapshot and free it two epochs later, once every reader that
+    // could have seen it is gone (epoch based reclamation). push_back() returns a handle for remove().
+    class callback_chain {
+    public:
+        typedef uint32_t handle;
+
+        handle push_back( const heal_callback_in &fn );
+        bool remove( handle h );
+        void clear();
+        size_t size() const;
+        bool empty() const;
+        bool dispatch( const std::string &text ) const;
+        bool active() const { // anyone to consume a report? callbacks, or add_worker() threads
+            return listeners.load( std::memory_order_relaxed ) != 0;
+        }
+
+    private:
+        friend void add_worker( heal_callback_in fn, bool replace_defaults );
+        struct snapshot;
+        std::atomic< const snapshot * > current;
+        std::atomic< uint32_t > listeners;
+        enum { reader_stripes = 8 };
+        struct reader_stripe {
+            std::atomic< uint32_t > count;
+            char padding[ 64 - sizeof( std::atomic< uint32_t > ) ]; // one cache line each
+        };
+        mutable reader_stripe readers[ 2 ][ reader_stripes ]; // by epoch parity
+        std::atomic< uint32_t > epoch;
+        const snapshot *retired; // writers only
+        void publish( const snapshot *next );
+        friend struct chain_reader;
+    };
+
+    extern callback_chain warns;
+    extern callback_chain fails;
 
     void warn( const std::string &error );
     void fail( const std::string &error );
 
-    void add_worker( heal_callback_in fn );
+    // per-callsite rate limiting for HEAL_WARN() and HEAL_FAIL(). a token bucket of `burst` reports, refilled at `rate`
+    // per second, kept as a single timestamp (GCRA). a suppressed report costs a clock read and one relaxed increment,
+    // and never builds its text. the next admitted report carries a "suppressed N times" summary.
+#   ifndef HEAL_CALLSITE_RATE
+#   define HEAL_CALLSITE_RATE  10
+#   endif
+#   ifndef HEAL_CALLSITE_BURST
+#   define HEAL_CALLSITE_BURST 10
+#   endif
+
+    struct callsite {
+        const char *file;
+        int line;
+        unsigned rate, burst;
+        std::atomic<int64_t> allow_at;      // steady clock microseconds of the next admitted report
+        std::atomic<uint64_t> suppressed;
+
+        constexpr callsite( const char *file, int line, unsigned rate = HEAL_CALLSITE_RATE, unsigned burst = HEAL_CALLSITE_BURST )
+        : file( file ), line( line ), rate( rate ? rate : 1 ), burst( burst ? burst : 1 ), allow_at( 0 ), suppressed( 0 )
+        {}
+
+        // monotonic microseconds. the coarse linux clock is a few ns (and a tick or so behind), plenty for rate limits
+        static int64_t clock() {
+            $linux(
+                struct timespec ts;
+                clock_gettime( CLOCK_MONOTONIC_COARSE, &ts );
+                return int64_t( ts.tv_sec ) * 1000000 + ts.tv_nsec / 1000;
+            )
+            return std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+        }
+        bool admit() {
+            int64_t now = clock();
+            if( $likely( now < allow_at.load( std::memory_order_relaxed ) ) ) {
+                suppressed.fetch_add( 1, std::memory_order_relaxed );
+                return false;
+            }
+            return admit_slow( now );
+        }
+        bool admit_slow( int64_t now );
+        std::string summary( const std::string &text );
+    };
+
+#   define HEAL_WARN(text) HEAL_CALLSITE_REPORT( heal::warn, text )
+#   define HEAL_FAIL(text) HEAL_CALLSITE_REPORT( heal::fail, text )
+#   define HEAL_CALLSITE_REPORT( fn, text ) do { \
+        static heal::callsite heal_callsite_( __FILE__, __LINE__ ); \
+        if( heal_callsite_.admit() ) fn( heal_callsite_.summary( text ) ); \
+    } while( 0 )
+
+    // lazily formatted reports: HEAL_WARNF( "cannot open \1 (error \2)", path, code ). sfstring placeholders.
+    // arguments are captured as fmtargs (strings by reference, scalars by value) and only formatted when a callback
+    // or worker is listening. inline cost at the call site is a load, a compare and a jump. gone in $public builds.
+    struct fmtarg {
+        enum kind { i64, u64, f64, cstr, str, ptr } type;
+        union {
+            int64_t i;
+            uint64_t u;
+            double d;
+            const char *s;
+            const std::string *string;
+            const void *p;
+        };
+        fmtarg( int v ) : type( i64 ), i( v ) {}
+        fmtarg( long v ) : type( i64 ), i( v ) {}
+        fmtarg( long long v ) : type( i64 ), i( v ) {}
+        fmtarg( unsigned v ) : type( u64 ), u( v ) {}
+        fmtarg( unsigned long v ) : type( u64 ), u( v ) {}
+        fmtarg( unsigned long long v ) : type( u64 ), u( v ) {}
+        fmtarg( double v ) : type( f64 ), d( v ) {}
+        fmtarg( const char *v ) : type( cstr ), s( v ) {}
+        fmtarg( char *v ) : type( cstr ), s( v ) {}
+        fmtarg( const std::string &v ) : type( str ), string( &v ) {}
+        fmtarg( const std::string &&v ) = delete; // a temporary (e.g. from an operator std::string()) dies before the list is used
+        template<typename T>
+        fmtarg( T *v ) : type( ptr ), p( v ) {}
+    };
+
+    // safe formatting: \1..\N in `fmt` are replaced by the arguments. sfformat() measures the output first and
+    // allocates once; sfformat_to() writes into the caller's buffer, never past `capacity`, and returns the length
+    // it needed (like snprintf). integers are converted by hand; floating point and pointers still use snprintf.
+    size_t format_list_to( char *out, size_t capacity, const char *fmt, size_t fmt_len, const fmtarg *args, size_t num_args );
+    std::string format_list( const char *fmt, size_t fmt_len, const fmtarg *args, size_t num_args );
+
+    template<typename... T>
+    std::string sfformat( const char *fmt, const T &... args ) {
+        const fmtarg list[] = { fmtarg( args )..., fmtarg( 0 ) };
+        return format_list( fmt, fmt ? strlen( fmt ) : 0, list, sizeof...(T) );
+    }
+    template<typename... T>
+    std::string sfformat( const std::string &fmt, const T &... args ) {
+        const fmtarg list[] = { fmtarg( args )..., fmtarg( 0 ) };
+        return format_list( fmt.data(), fmt.size(), list, sizeof...(T) );
+    }
+    template<typename... T>
+    size_t sfformat_to( char *out, size_t capacity, const char *fmt, const T &... args ) {
+        const fmtarg list[] = { fmtarg( args )..., fmtarg( 0 ) };
+        return format_list_to( out, capacity, fmt, fmt ? strlen( fmt ) : 0, list, sizeof...(T) );
+    }
+
+    // cold path of HEAL_WARNF()/HEAL_FAILF(): formats `fmt` with `args` and calls `fn` with it
+    void reportf( void (*fn)( const std::string & ), const char *fmt, const fmtarg *args, size_t num_args );
+
+    template<typename... T>
+    $gnuc( __attribute__((noinline, cold)) ) $msvc( __declspec(noinline) )
+    void warnf( const char *fmt, const T &... args ) {
+        const fmtarg list[] = { fmtarg( args )..., fmtarg( 0 ) };
+        reportf( warn, fmt, list, sizeof...(T) );
+    }
+    template<typename... T>
+    $gnuc( __attribute__((noinline, cold)) ) $msvc( __declspec(noinline) )
+    void failf( const char *fmt, const T &... args ) {
+        const fmtarg list[] = { fmtarg( args )..., fmtarg( 0 ) };
+        reportf( fail, fmt, list, sizeof...(T) );
+    }
+
+#   if $on($public)
+#   define HEAL_WARNF(...) do {} while( 0 )
+#   define HEAL_FAILF(...) do {} while( 0 )
+#   else
+#   define HEAL_WARNF(...) do { if( $unlikely( heal::warns.active() ) ) heal::warnf( __VA_ARGS__ ); } while( 0 )
+#   define HEAL_FAILF(...) do { if( $unlikely( heal::fails.active() ) ) heal::failf( __VA_ARGS__ ); } while( 0 )
+#   endif
+
+    // binary logging, NanoLog style. HEAL_LOG( "miss on \1 after \2 us", key, us ) registers its format once per
+    // callsite (on its first record), then only copies the format id, a cycle counter and the raw arguments into a per-thread ring.
+    // nothing is formatted: a background thread drains the rings into a binary file between start() and stop(),
+    // and decode() (or the heal-binlog tool) turns that file into text later. full rings drop and count.
+    struct binlog {
+        static bool start( const std::string &path );
+        static void stop();
+        static std::string decode( std::istream &file );
+        static uint64_t dropped(); // records lost on full rings since start()
+        static bool running() {
+            return enabled.load( std::memory_order_relaxed );
+        }
+        static uint64_t cycles() {
+            #if defined(__x86_64__) || defined(__i386__)
+            return __builtin_ia32_rdtsc();
+            #elif defined(__aarch64__)
+            uint64_t v; asm volatile( "mrs %0, cntvct_el0" : "=r"( v ) ); return v;
+            #else
+            return uint64_t( std::chrono::steady_clock::now().time_since_epoch().count() );
+            #endif
+        }
+
+        static uint32_t define( const char *file, int line, const char *fmt, const fmtarg *args, size_t num_args );
+        static void record( uint32_t id, const fmtarg *args, size_t num_args );
+        static std::atomic<bool> enabled;
+    };
+
+    // the arguments are evaluated once, here; the first record of a callsite also registers its format from them
+    template<typename... T>
+    inline void binlog_write( std::atomic<uint32_t> &id, const char *file, int line, const char *fmt, const T &... args ) {
+        if( $likely( binlog::running() ) ) {
+            const fmtarg list[] = { fmtarg( args )..., fmtarg( 0 ) };
+            uint32_t known = id.load( std::memory_order_acquire );
+            if( $unlikely( !known ) ) {
+                uint32_t defined = binlog::define( file, line, fmt, list, sizeof...(T) );
+                known = id.compare_exchange_strong( known, defined ) ? defined : known; // a racing thread may win
+            }
+            binlog::record( known, list, sizeof...(T) );
+        }
+    }
+
+#   define HEAL_LOG(...) do { \
+        static std::atomic<uint32_t> heal_binlog_id_( 0 ); \
+        heal::binlog_write( heal_binlog_id_, __FILE__, __LINE__, __VA_ARGS__ ); \
+    } while( 0 )
+
+    // add_worker() callbacks run on background threads: warn() and fail() queue their text and return at once.
+    // warns/fails callbacks still run inline, so keep them short. that includes the default (blocking) alert and
+    // debugger handlers, unless some add_worker() call asked them to step aside with replace_defaults.
+    // on a full queue, drop_oldest discards the oldest report, block_when_full waits for room, and sample_when_full
+    // admits 1 report in HEAL_WORKER_SAMPLE. capacity and threads must be set before the first add_worker().
+    // die() and normal exit() flush the queue (HEAL_WORKER_EXIT_MS at most) before the process goes away.
+    enum worker_policy { drop_oldest, block_when_full, sample_when_full };
+    struct worker_stats {
+        uint64_t queued, processed, dropped, depth;
+    };
+    void add_worker( heal_callback_in fn, bool replace_defaults = false );
+    bool set_worker_queue( size_t capacity, worker_policy policy = drop_oldest, unsigned threads = 1 );
+    bool flush_workers( unsigned timeout_ms = 1000 );
+    worker_stats get_worker_stats();
 
     void die( const std::string &reason, int errorcode = -1 );
     void die( int errorcode = -1, const std::string &reason = std::string() );
@@ -264,17 +485,127 @@ namespace heal {
     #define HEAL_MAX_TRACES 128
     #endif
 
-    struct callstack /* : public std::vector<const void*> */ {
-        enum { max_frames = HEAL_MAX_TRACES };
-        std::vector<void *> frames;
-        callstack( bool autosave = false );
-        size_t space() const;
-        void save( unsigned frames_to_skip = 0 );
-        std::vector<std::string> unwind( unsigned from = 0, unsigned to = ~0 ) const;
+    // stack unwinding engine used by capture(). backtrace is the default and works everywhere.
+    // framepointer is fastest but needs -fno-omit-frame-pointer on all code; ehframe interprets and caches
+    // .eh_frame unwind tables (x86_64 linux only). returns false if the engine is not available.
+    enum unwinder { backtrace_unwinder, framepointer_unwinder, ehframe_unwinder };
+    bool set_unwinder( unwinder engine );
+
+    // span based api. capture() fills caller-provided storage with return addresses of current thread,
+    // does no heap allocations and returns the captured depth.
+    unsigned capture( void **frames, unsigned capacity, unsigned frames_to_skip = 0 );
+    std::vector<std::string> unwind( void * const *frames, size_t num_frames, unsigned from = 0, unsigned to = ~0u );
+    std::vector<std::string> format_stack( void * const *frames, size_t num_frames, const char *format12 = "#\1 \2\n", size_t skip_begin = 0 );
+
+    // fixed capacity, inline storage with a std::vector-alike interface
+    template<unsigned N>
+    struct frame_array {
+        typedef void *value_type;
+        typedef void **iterator;
+        typedef void * const *const_iterator;
+
+        frame_array() : count(0)
+        {}
+
+        size_t size() const { return count; }
+        size_t capacity() const { return N; }
+        bool empty() const { return !count; }
+        void clear() { count = 0; }
+        void resize( size_t n, void *value = 0 ) {
+            for( n = n < N ? n : N; count < n; ) items[ count++ ] = value;
+            count = unsigned( n );
+        }
+        void push_back( void *frame ) { if( count < N ) items[ count++ ] = frame; }
+        void pop_back() { if( count ) --count; }
+
+        void **data() { return items; }
+        void * const *data() const { return items; }
+        iterator begin() { return items; }
+        iterator end() { return items + count; }
+        const_iterator begin() const { return items; }
+        const_iterator end() const { return items + count; }
+        void *&operator[]( size_t i ) { return items[i]; }
+        void * const &operator[]( size_t i ) const { return items[i]; }
+
+        private: void *items[ N ? N : 1 ]; unsigned count;
+        template<unsigned> friend struct basic_callstack;
+    };
+
+    // interned stack, see intern(). ids are process-wide, stable and never released. 0 is the empty stack.
+    struct stackid {
+        uint32_t id;
+
+        explicit stackid( uint32_t id = 0 ) : id( id )
+        {}
+
+        size_t size() const;
+        void * const *frames() const;
+        std::vector<std::string> unwind( unsigned from = 0, unsigned to = ~0u ) const;
         std::vector<std::string> str( const char *format12 = "#\1 \2\n", size_t skip_begin = 0 ) const;
         std::string flat( const char *format12 = "#\1 \2\n", size_t skip_begin = 0 ) const;
+
+        bool operator==( const stackid &other ) const { return id == other.id; }
+        bool operator!=( const stackid &other ) const { return id != other.id; }
+        bool operator <( const stackid &other ) const { return id  < other.id; }
     };
 
+    // stack depot. stores each distinct frame array once and returns its id. lock-free.
+    stackid intern( void * const *frames, size_t num_frames );
+
+    struct stack_depot_stats {
+        uint64_t stacks, bytes;
+    };
+    stack_depot_stats get_stack_depot_stats();
+
+    // deferred symbolization. dump raw frames now, plus a module_snapshot() once, and symbolize them later
+    // with symbolize_dump() or the heal-symbolize tool.
+    std::string module_snapshot();
+    std::string dump_stack( void * const *frames, size_t num_frames );
+    std::string symbolize( const std::string &binary, uint64_t offset );
+    std::string symbolize_dump( std::istream &dump, const char *format12 = "#\1 \2\n" );
+
+    template<unsigned N>
+    struct basic_callstack {
+        enum { max_frames = N };
+        frame_array<N> frames;
+
+        // never inlined, so there is always exactly one frame of ours to skip: the trace starts at the caller
+        // whatever the optimization level. the store after capture() keeps it from becoming a tail call.
+        $gnuc( __attribute__((noinline)) ) $msvc( __declspec(noinline) )
+        basic_callstack( bool autosave = false ) {
+            if( autosave ) frames.count = heal::capture( frames.data(), N, 1 );
+        }
+        size_t space() const {
+            return sizeof(frames);
+        }
+        $gnuc( __attribute__((noinline)) ) $msvc( __declspec(noinline) )
+        unsigned save( unsigned frames_to_skip = 0 ) {
+            return frames.count = heal::capture( frames.data(), N, frames_to_skip + 1 );
+        }
+        std::vector<std::string> unwind( unsigned from = 0, unsigned to = ~0u ) const {
+            return heal::unwind( frames.data(), frames.size(), from, to );
+        }
+        std::vector<std::string> str( const char *format12 = "#\1 \2\n", size_t skip_begin = 0 ) const {
+            return heal::format_stack( frames.data(), frames.size(), format12, skip_begin );
+        }
+        std::string flat( const char *format12 = "#\1 \2\n", size_t skip_begin = 0 ) const {
+            std::vector<std::string> vec = str( format12, skip_begin );
+            std::string out;
+            for( std::vector<std::string>::const_iterator it = vec.begin(), end = vec.end(); it != end; ++it ) {
+                out += *it;
+            }
+            return out;
+        }
+        stackid intern() const {
+            return heal::intern( frames.data(), frames.size() );
+        }
+        std::string dump() const {
+            return heal::dump_stack( frames.data(), frames.size() );
+        }
+    };
+
+    typedef basic_callstack<HEAL_MAX_TRACES> callstack;
+
     template<typename T>
     static inline
     std::string lookup( T *ptr ) {
@@ -284,12 +615,172 @@ namespace heal {
         return stacktrace.size() ? stacktrace[0] : std::string("????");
     }
 
+    struct symbol_cache_stats {
+        uint64_t hits, misses, flushes, entries;
+    };
+    symbol_cache_stats get_symbol_cache_stats();
+    void clear_symbol_cache();
+    bool set_symbolizer( const std::string &backends ); // comma separated chain, ie "dwarf,addr2line"
+
     std::string demangle( const std::string &mangled );
     std::vector<std::string> stacktrace( const char *format12 = "#\1 \2\n", size_t skip_initial = 0 );
     std::string stackstring( const char *format12 = "#\1 \2\n", size_t skip_initial = 0 );
 
+    // callstacks of every thread in the process, keyed by "tid name". other threads are interrupted with a real-time
+    // signal (HEAL_THREAD_SIGNAL) and unwind themselves; those not answering within timeout_ms get an empty callstack.
+    // the signal makes plain usleep()/nanosleep() calls of those threads return early (EINTR).
+    std::map< std::string, callstack > all_stacks( unsigned timeout_ms = 100 );
+
+
+    // sampling profiler. dump() returns folded stacks ("main;foo;bar 42\n"), as used by flame graphs.
+    // cpu mode samples on cpu time (SIGPROF). wall mode samples every registered thread on real time,
+    // sleeping or not, and roots each stack with the thread state, like "[running];main;foo 42\n".
+    // only running threads get signaled there; blocked ones are unwound from outside, their syscalls untouched.
+    struct profiler {
+        enum mode { cpu, wall };
+        static bool start( unsigned hz = 99, mode m = cpu );
+        static void stop();
+        static std::string dump();
+        static void register_thread();
+        static void unregister_thread();
+    };
+
+    // crash-surviving flight recorder. small binary events go into per-thread rings that live in a MAP_SHARED file
+    // mapping: the kernel keeps them even if the process gets SIGKILLed or OOM killed. record() is lock-free and
+    // makes no syscalls once the thread owns a slot; the first record() (or an up-front register_thread()) claims
+    // one and reads the tid and thread name. threads left without a slot retry once another thread exits. stacks, when given, are copied into the file the first time they are seen, next to a
+    // module_snapshot(), so decode() (or the heal-flight tool) can symbolize them after the process is gone.
+    struct flight_recorder {
+        static bool open( const std::string &path, unsigned threads = 64, unsigned events_per_thread = 1024 );
+        static void close();
+        static void name( uint32_t event, const char *name );
+        static bool register_thread();
+        static void record( uint32_t event, uint64_t a = 0, uint64_t b = 0, uint64_t c = 0, uint64_t d = 0 );
+        static void record( uint32_t event, stackid stack, uint64_t a = 0, uint64_t b = 0, uint64_t c = 0, uint64_t d = 0 );
+        static std::string decode( std::istream &file );
+    };
+
+    // heap profile: live bytes per callstack, biggest first. subtract two profiles to get the growth in between.
+    struct heap_profile {
+        struct site {
+            stackid stack;
+            int64_t bytes, count;
+        };
+        std::vector<site> sites;
+        int64_t bytes, count;
+
+        heap_profile() : bytes(0), count(0) {}
+        heap_profile operator-( const heap_profile &before ) const;
+        std::string str( size_t top = 20 ) const;
+    };
+
+    // heap tracker. requires heal.cpp built with HEAL_TRACK_ALLOCATIONS defined, which replaces global operator new/delete
+    // (and interposes malloc/calloc/realloc/free on glibc). sample_interval = 0 tracks every allocation; otherwise
+    // about one allocation per `sample_interval` bytes is tracked (ie, 512 KiB) and totals are estimated from samples.
+    struct allocations {
+        static bool start( bool report_at_exit = false, size_t sample_interval = 0 );
+        static void stop();
+        static heap_profile snapshot();
+        static std::string report( size_t top = 20 );
+    };
+
+    // async-signal-safe output for crash paths: formats into a fixed buffer on the stack and flushes it with
+    // write(2) when full, on flush() and on destruction. never allocates nor locks, so it keeps working from
+    // signal handlers and with a corrupted or exhausted heap. usage: sigsafe_writer(2).str("pid ").dec(pid).chr('\n');
+    class sigsafe_writer {
+        public:
+        explicit sigsafe_writer( int fd = 2 ) : fd( fd ), len( 0 )
+        {}
+        ~sigsafe_writer() {
+            flush();
+        }
+        sigsafe_writer &str( const char *s );
+        sigsafe_writer &str( const char *s, size_t n );
+        sigsafe_writer &chr( char c ) {
+            if( len == sizeof(buf) ) flush();
+            buf[ len++ ] = c;
+            return *this;
+        }
+        template<typename T>
+        sigsafe_writer &dec( T v ) {
+            return v < T(0) ? chr( '-' ).udec( 0 - uint64_t( v ) ) : udec( uint64_t( v ) );
+        }
+        sigsafe_writer &udec( uint64_t v );
+        sigsafe_writer &hex( uint64_t v, unsigned min_digits = 0 ); // 0x-prefixed
+        sigsafe_writer &ptr( const void *p ) {
+            return hex( uint64_t( uintptr_t( p ) ) );
+        }
+        void flush();
+
+        private:
+        sigsafe_writer( const sigsafe_writer & );
+        sigsafe_writer &operator=( const sigsafe_writer & );
+        int fd;
+        unsigned len;
+        char buf[ 512 ];
+    };
+
+    // crash handler. on SIGSEGV/SIGBUS/SIGFPE/SIGILL/SIGABRT writes signal, fault address, registers and raw frames
+    // to `fd`, from an alternate stack and with async-signal-safe calls only, then re-raises the signal. symbolize
+    // also appends the symbolized stack from a forked child. call it from other threads to give them an alternate stack.
+    bool install_crash_handler( int fd = 2, bool symbolize = true );
+
+    // crash file. once set, the crash handler also writes `path` with a single writev(): registers and raw frames of
+    // every thread, the top `stack_kb` of each stack, loaded modules with build-ids and the crash_annotate() notes.
+    // crash_report() (or the heal-crashdump tool) decodes and symbolizes it offline. an empty path disables it.
+    bool set_crash_file( const std::string &path, unsigned stack_kb = 16 );
+    bool crash_annotate( const std::string &key, const std::string &value ); // empty value removes the key
+    std::string crash_report( std::istream &file, const char *format12 = "  #\1 \2\n", bool with_stacks = false );
+
+    // hexdump. each row shows `width` bytes twice, as characters ("asc") and as hex ("hex"), labeled with the
+    // address of `self` (or `data`) plus offset. max_rows limits the output, and a limited dump says how many
+    // bytes it left out. hexdump_to() streams the text to an ostream, fd or callback in large chunks instead of
+    // building a string, and returns the number of bytes dumped. big dumps are rendered by several threads.
+    struct hexdump_options {
+        unsigned width;         // bytes per row, 1..256
+        size_t max_rows;        // 0 for no limit
+        const void *self;       // address shown for the first byte
+        bool skip_repeated;     // print a run of rows identical to the one above as a single "*", like hexdump -C
+        unsigned threads;       // renderers for big dumps. 0 for one per core, up to 8
+
+        explicit hexdump_options( unsigned width = 16, size_t max_rows = 0, const void *self = 0 )
+        : width( width ), max_rows( max_rows ), self( self ), skip_repeated( false ), threads( 0 )
+        {}
+    };
+    typedef void (*hexdump_sink)( const char *text, size_t size, void *user );
 
     std::string hexdump( const void *data, size_t num_bytes, const void *self = 0 );
+    std::string hexdump( const void *data, size_t num_bytes, const hexdump_options &options );
+    size_t hexdump_to( std::ostream &os, const void *data, size_t num_bytes, const hexdump_options &options = hexdump_options() );
+    size_t hexdump_to( int fd, const void *data, size_t num_bytes, const hexdump_options &options = hexdump_options() );
+    size_t hexdump_to( hexdump_sink sink, void *user, const void *data, size_t num_bytes, const hexdump_options &options = hexdump_options() );
+
+    // hexdiff. compares two buffers (vectorized, at memory speed) and prints only the rows that differ, plus
+    // `context` identical rows around them. a row that differs is printed twice, tagged "a" and "b", and the
+    // changed bytes are highlighted: in color, or with a "^^" line below. rows are labeled with offsets.
+    // returns the number of differing bytes; the output ends with that count too.
+    struct hexdiff_options {
+        unsigned width;         // bytes per row, 1..256
+        unsigned context;       // identical rows shown around each difference
+        size_t max_rows;        // differing rows shown at most. 0 for no limit
+        bool color;             // highlight with ANSI colors instead of a marker line
+
+        explicit hexdiff_options( unsigned width = 16, unsigned context = 1, size_t max_rows = 0, bool color = false )
+        : width( width ), context( context ), max_rows( max_rows ), color( color )
+        {}
+    };
+
+    std::string hexdiff( const void *a, const void *b, size_t num_bytes, const hexdiff_options &options = hexdiff_options() );
+    size_t hexdiff_to( std::ostream &os, const void *a, const void *b, size_t num_bytes, const hexdiff_options &options = hexdiff_options() );
+    size_t hexdiff_to( hexdump_sink sink, void *user, const void *a, const void *b, size_t num_bytes, const hexdiff_options &options = hexdiff_options() );
+    size_t mismatch( const void *a, const void *b, size_t num_bytes, size_t from = 0 ); // first differing offset >= from, or num_bytes
+
+    // hexdump of a file range, mmap'ed read-only: nothing gets copied into the heap. rows are labeled with file
+    // offsets (plus `self`, if any). length is clamped to the end of the file. returns false on errors only:
+    // an empty file or a range past its end dumps no rows, and succeeds.
+    bool hexdump_file( std::ostream &os, const std::string &path, uint64_t offset = 0, uint64_t length = ~0ull, const hexdump_options &options = hexdump_options() );
+    bool hexdump_file( hexdump_sink sink, void *user, const std::string &path, uint64_t offset = 0, uint64_t length = ~0ull, const hexdump_options &options = hexdump_options() );
+    bool hexdump_fd( hexdump_sink sink, void *user, int fd, uint64_t offset = 0, uint64_t length = ~0ull, const hexdump_options &options = hexdump_options() );
 
     template<typename T> inline std::string hexdump( const T& obj ) {
         return hexdump( obj.data(), obj.size() * sizeof(*obj.begin()), &obj );
@@ -348,4 +839,12 @@ namespace heal {
     std::string timestamp();
 }
 
+$cpp11(
+namespace std {
+    template<> struct hash< heal::stackid > {
+        size_t operator()( const heal::stackid &s ) const { return std::hash<uint32_t>()( s.id ); }
+    };
+}
+)
+
 #endif // __HEALHPP__